@@ -0,0 +1,59 @@
+/*
+ * compile-ids.cc
+ *
+ * compiles pci.ids, usb.ids, pnp.ids and pnpid.txt into the binary ID
+ * database used by lshw (see core/iddb.h): either the given files (at build
+ * time) or all the ones lshw would load on this system, which is what it
+ * needs to use the database; installed as lshw-compile-ids, to be run again
+ * whenever one of these files is updated
+ *
+ */
+
+#include "version.h"
+#include "iddb.h"
+#include "pci.h"
+#include "usb.h"
+#include "pnp.h"
+
+#include <stdio.h>
+
+__ID("@(#) $Id$");
+
+using namespace std;
+
+void status(const char *)
+{
+}
+
+
+int main(int argc,
+char **argv)
+{
+  iddb_writer db;
+
+  if (argc == 2)
+  {
+    export_pcidb(db);
+    export_usbdb(db);
+    export_pnpdb(db);
+  }
+  else if (argc == 6)
+  {
+    export_pcidb(db, vector < string > (1, argv[2]));
+    export_usbdb(db, vector < string > (1, argv[3]));
+    export_pnpdb(db, vector < string > (1, argv[4]), vector < string > (1, argv[5]));
+  }
+  else
+  {
+    fprintf(stderr, "usage: %s output [pci.ids usb.ids pnp.ids pnpid.txt]\n", argv[0]);
+    exit(1);
+  }
+
+  if (!db.write(argv[1]))
+  {
+    perror(argv[1]);
+    exit(1);
+  }
+
+  return 0;
+}
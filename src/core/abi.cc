@@ -30,12 +30,12 @@ bool scan_abi(hwNode & system)
     system.setWidth(64);
   }
 
-  if(chdir("abi") == 0)
+  if(pushd("abi"))
   {
     int i,n;
     struct dirent **namelist;
 
-    n = scandir(".", &namelist, selectfile, alphasort);
+    n = scan_dir(".", &namelist, selectfile);
     for(i=0; i<n; i++)
     {
       system.addCapability(namelist[i]->d_name);
@@ -43,6 +43,7 @@ bool scan_abi(hwNode & system)
     }
     if(namelist)
       free(namelist);
+    popd();
   }
 
   popd();
@@ -18,6 +18,7 @@
 #include "version.h"
 #include "cdrom.h"
 #include "partitions.h"
+#include "osutils.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
@@ -52,7 +53,7 @@ bool scan_cdrom(hwNode & n)
 
   n.addHint("icon", string("cd"));
 
-  int fd = open(n.getLogicalName().c_str(), O_RDONLY | O_NONBLOCK);
+  int fd = open_file(n.getLogicalName(), O_RDONLY | O_NONBLOCK);
 
   if (fd < 0)
     return false;
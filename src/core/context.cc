@@ -0,0 +1,51 @@
+/*
+ * context.cc
+ *
+ *
+ */
+
+#include "version.h"
+#include "context.h"
+
+__ID("@(#) $Id$");
+
+using namespace std;
+
+static thread_local scan_context *current = NULL;
+
+scan_context::scan_context():
+  sysfs("/sys")
+{
+}
+
+void scan_context::reset()
+{
+  map < type_index, shared_ptr < void > > old;
+
+  {
+    lock_guard < recursive_mutex > lock(m);
+    old.swap(states);
+  }
+  // destroyed here, outside of the lock
+}
+
+scan_context & context()
+{
+  static scan_context defaultcontext;
+
+  if (current)
+    return *current;
+
+  return defaultcontext;
+}
+
+context_guard::context_guard(scan_context & c):
+  previous(current)
+{
+  current = &c;
+}
+
+context_guard::~context_guard()
+{
+  current = previous;
+}
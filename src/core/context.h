@@ -0,0 +1,67 @@
+#ifndef _CONTEXT_H_
+#define _CONTEXT_H_
+
+#include <string>
+#include <set>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <typeindex>
+
+/*
+ * Everything a scan depends on besides the tree it fills: the options and
+ * the state scanners keep between calls. scan_system() makes its context
+ * current on the threads it uses; code running there gets it with context().
+ * Outside of a scan, context() is a process-wide default.
+ *
+ * ID databases (pci.ids, usb.ids...) aren't part of it: they are loaded once
+ * and shared read-only by all scans.
+ */
+class scan_context
+{
+  public:
+    scan_context();
+
+    std::set < std::string > disabled_tests;
+    std::set < std::string > visible_classes;
+    std::map < std::string, std::string > aliases;
+
+    std::string sysfs;                            // where sysfs is mounted
+    std::string sysroot;                          // read the system from there
+    std::string capture;                          // copy what was read there
+
+// state of a scanner, created on first use and kept until reset()
+    template < class T > T & state()
+    {
+      std::lock_guard < std::recursive_mutex > lock(m);
+      std::shared_ptr < void > & s = states[std::type_index(typeid(T))];
+
+      if (!s)
+        s = std::make_shared < T > ();
+      return *static_cast < T * > (s.get());
+    }
+
+    void reset();
+
+  private:
+    scan_context(const scan_context &);
+    scan_context & operator =(const scan_context &);
+
+    std::map < std::type_index, std::shared_ptr < void > > states;
+    std::recursive_mutex m;
+};
+
+scan_context & context();
+
+// makes a context current for the calling thread while it exists
+class context_guard
+{
+  public:
+    context_guard(scan_context &);
+    ~context_guard();
+
+  private:
+    scan_context *previous;
+};
+
+#endif
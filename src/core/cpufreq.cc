@@ -26,7 +26,7 @@ __ID("@(#) $Id$");
 static long get_long(const string & path)
 {
   long result = 0;
-  FILE * in = fopen(path.c_str(), "r");
+  FILE * in = fopen_file(path);
 
   if (in)
   {
@@ -1,6 +1,11 @@
+#define _LARGEFILE_SOURCE
+#define _FILE_OFFSET_BITS 64
+
 #include "version.h"
 #include "config.h"
 #include "cpuid.h"
+#include "osutils.h"
+#include "context.h"
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -8,6 +13,8 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <cstring>
+#include <map>
+#include <stdint.h>
 
 __ID("@(#) $Id$");
 
@@ -83,6 +90,162 @@ int n = 0)
 	   : "=a" (a), "=r" (b), "=c" (c), "=d" (d)	\
 	   : "0" (in))
 
+struct cpuid_regs
+{
+  unsigned long eax, ebx, ecx, edx;
+};
+
+/*
+ * /dev/cpu/N/cpuid is kept open for the whole scan and leaves are read with
+ * pread(). Leaves that only depend on the processor model (cache parameters,
+ * brand string, frequency, see cpuid_shared()) are read once and shared by all
+ * the logical CPUs of identical packages; the others (APIC IDs, serial number,
+ * leaf 2 which may have to be queried repeatedly) are always read from the CPU
+ * itself.
+ *
+ * -capture records the leaves read (from the device or with the CPUID
+ * instruction) as lines of text in a file of the same name:
+ *   leaf eax ebx ecx edx
+ * all in hexadecimal; -sysroot replays them from there.
+ */
+struct cpuid_device
+{
+  string path;
+  int fd;
+  bool recorded;                                  // a file made by -capture
+  map < unsigned long, cpuid_regs > leaves;       // what it contains
+  string model;                                   // vendor + signature
+};
+
+struct cpuid_state
+{
+  map < int, cpuid_device > cpuid_devices;
+  map < string, map < unsigned long, cpuid_regs > > cpuid_models;
+};
+
+static cpuid_state & state()
+{
+  return context().state<cpuid_state>();
+}
+
+// leaves that are the same on every CPU of a given model: anything else (APIC
+// IDs in 0xB, 0x1F and 0x8000001E, etc.) is read from each CPU
+static bool cpuid_shared(unsigned long idx)
+{
+  switch (idx)
+  {
+    case 0x4:                                     // cache parameters
+    case 0x15:                                    // TSC/crystal clock ratio
+    case 0x16:                                    // processor frequency
+      return true;
+    default:                                      // extended leaves, brand
+      return (idx >= 0x80000000) && (idx <= 0x80000008);
+  }
+}
+
+
+static void cpuid_read(cpuid_device & dev,
+unsigned long idx,
+cpuid_regs & regs)
+{
+  uint32_t buffer[4];
+  char record[80];
+
+  memset(buffer, 0, sizeof(buffer));
+  if (dev.recorded)
+  {
+    map < unsigned long, cpuid_regs >::const_iterator leaf = dev.leaves.find(idx);
+
+    if (leaf != dev.leaves.end())
+      regs = leaf->second;
+    return;
+  }
+  else
+  if (dev.fd >= 0)
+  {
+    if(pread(dev.fd, buffer, sizeof(buffer), (off_t) idx) != sizeof(buffer))
+      return;
+    regs.eax = buffer[0];
+    regs.ebx = buffer[1];
+    regs.ecx = buffer[2];
+    regs.edx = buffer[3];
+  }
+  else
+  if (context().sysroot.empty())                 // only describes this machine
+    cpuid_up(idx, regs.eax, regs.ebx, regs.ecx, regs.edx);
+  else
+    return;
+
+  snprintf(record, sizeof(record), "%lx %08lx %08lx %08lx %08lx\n", idx,
+    regs.eax & 0xffffffffUL, regs.ebx & 0xffffffffUL, regs.ecx & 0xffffffffUL, regs.edx & 0xffffffffUL);
+  capture_data(dev.path, record);
+}
+
+
+// leaves recorded by -capture (the first one wins when a leaf was read again)
+static void cpuid_load(cpuid_device & dev)
+{
+  vector < string > records;
+
+  if (!loadfile(dev.path, records))
+    return;
+
+  for (unsigned int i = 0; i < records.size(); i++)
+  {
+    unsigned long idx = 0;
+    cpuid_regs regs;
+
+    if (sscanf(records[i].c_str(), "%lx %lx %lx %lx %lx", &idx,
+      &regs.eax, &regs.ebx, &regs.ecx, &regs.edx) == 5)
+      dev.leaves.insert(make_pair(idx, regs));
+  }
+}
+
+
+static cpuid_device & cpuid_open(int cpunumber)
+{
+  map < int, cpuid_device >::iterator i = state().cpuid_devices.find(cpunumber);
+
+  if (i == state().cpuid_devices.end())
+  {
+    char cpuname[50];
+    struct stat info;
+    cpuid_device dev;
+    cpuid_regs vendor, signature;
+
+    snprintf(cpuname, sizeof(cpuname), "/dev/cpu/%d/cpuid", cpunumber);
+    dev.path = cpuname;
+    dev.fd = open_file(dev.path, O_RDONLY);
+    dev.recorded = (dev.fd >= 0) && (fstat(dev.fd, &info) == 0) && S_ISREG(info.st_mode);
+    if (dev.recorded)
+      cpuid_load(dev);
+
+    memset(&vendor, 0, sizeof(vendor));
+    memset(&signature, 0, sizeof(signature));
+    cpuid_read(dev, 0, vendor);
+    cpuid_read(dev, 1, signature);
+    dev.model = tohex(vendor.eax) + ":" + tohex(vendor.ebx) + ":" +
+      tohex(vendor.ecx) + ":" + tohex(vendor.edx) + ":" + tohex(signature.eax);
+
+    i = state().cpuid_devices.insert(make_pair(cpunumber, dev)).first;
+  }
+
+  return i->second;
+}
+
+
+static void cpuid_close()
+{
+  for (map < int, cpuid_device >::iterator i = state().cpuid_devices.begin();
+    i != state().cpuid_devices.end(); i++)
+    if (i->second.fd >= 0)
+      close(i->second.fd);
+
+  state().cpuid_devices.clear();
+  state().cpuid_models.clear();
+}
+
+
 static void cpuid(int cpunumber,
 unsigned long idx,
 unsigned long &eax,
@@ -90,27 +253,34 @@ unsigned long &ebx,
 unsigned long &ecx,
 unsigned long &edx)
 {
-  char cpuname[50];
-  int fd = -1;
-  unsigned char buffer[16];
+  cpuid_device & dev = cpuid_open(cpunumber);
+  cpuid_regs regs;
+
+  regs.eax = eax;
+  regs.ebx = ebx;
+  regs.ecx = ecx;
+  regs.edx = edx;
 
-  snprintf(cpuname, sizeof(cpuname), "/dev/cpu/%d/cpuid", cpunumber);
-  fd = open(cpuname, O_RDONLY);
-  if (fd >= 0)
+  if (cpuid_shared(idx))
   {
-    lseek(fd, idx, SEEK_CUR);
-    memset(buffer, 0, sizeof(buffer));
-    if(read(fd, buffer, sizeof(buffer)) == sizeof(buffer))
+    map < unsigned long, cpuid_regs > & leaves = state().cpuid_models[dev.model];
+    map < unsigned long, cpuid_regs >::iterator i = leaves.find(idx);
+
+    if (i == leaves.end())
     {
-      eax = (*(unsigned long *) buffer);
-      ebx = (*(unsigned long *) (buffer + 4));
-      ecx = (*(unsigned long *) (buffer + 8));
-      edx = (*(unsigned long *) (buffer + 12));
+      cpuid_read(dev, idx, regs);
+      leaves[idx] = regs;
     }
-    close(fd);
+    else
+      regs = i->second;
   }
   else
-    cpuid_up(idx, eax, ebx, ecx, edx);
+    cpuid_read(dev, idx, regs);
+
+  eax = regs.eax;
+  ebx = regs.ebx;
+  ecx = regs.ecx;
+  edx = regs.edx;
 }
 
 
@@ -590,18 +760,67 @@ long sleeptime = 250000)
 }
 
 
-static float average_MHz(int cpunum,
-int tries = 2)
+/*
+ * Find the CPU frequency without having to measure it: CPUID leaves 0x16
+ * (processor base frequency) and 0x15 (TSC/crystal clock ratio), then what
+ * the kernel reports through cpufreq or /proc/cpuinfo
+ */
+static float reported_MHz(int cpunum,
+unsigned long maxi)
 {
-  float frequency = 0;
+  unsigned long eax = 0, ebx = 0, ecx = 0, edx = 0;
+  char path[80];
+  long kHz = 0;
 
-  for (int i = 1; i <= tries; i++)
-    frequency += estimate_MHz(cpunum, i * 150000);
+  if (maxi >= 0x16)
+  {
+    cpuid(cpunum, 0x16, eax, ebx, ecx, edx);
+    if (eax & 0xffff)
+      return (float) (eax & 0xffff);
+  }
 
-  if (tries > 0)
-    return frequency / (float) tries;
-  else
+  if (maxi >= 0x15)
+  {
+    eax = ebx = ecx = edx = 0;
+    cpuid(cpunum, 0x15, eax, ebx, ecx, edx);
+    if (eax && ebx && ecx)                        // crystal clock (Hz) * TSC ratio
+      return (float) ((double) ecx * ebx / eax / 1E6);
+  }
+
+  snprintf(path, sizeof(path),
+    "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpunum);
+  kHz = get_number(path, 0);
+  if (kHz > 0)
+    return (float) kHz / 1000;
+
+  vector < string > cpuinfo;
+  int processor = -1;
+
+  if (!loadfile("/proc/cpuinfo", cpuinfo))
     return 0;
+
+  for (unsigned int i = 0; i < cpuinfo.size(); i++)
+  {
+    float MHz = 0;
+
+    if (sscanf(cpuinfo[i].c_str(), "processor : %d", &processor) == 1)
+      continue;
+    if ((processor == cpunum) &&
+      (sscanf(cpuinfo[i].c_str(), "cpu MHz : %f", &MHz) == 1))
+      return MHz;
+  }
+
+  return 0;
+}
+
+
+static long package_id(int cpunum)
+{
+  char path[80];
+
+  snprintf(path, sizeof(path),
+    "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpunum);
+  return get_number(path, 0);
 }
 
 
@@ -621,6 +840,7 @@ bool scan_cpuid(hwNode & n)
   unsigned long maxi, ebx, ecx, edx;
   hwNode *cpu = NULL;
   int currentcpu = 0;
+  map < long, float > frequencies;                // per physical package
 
   if (!haveCPUID())
     return false;
@@ -643,16 +863,31 @@ bool scan_cpuid(hwNode & n)
         docyrix(maxi, cpu, currentcpu);
         break;
       default:
+        cpuid_close();
         return false;
     }
 
     cpu->claim(true);                             // claim the cpu and all its children
     if (cpu->getSize() == 0)
-      cpu->setSize((unsigned long long) (1000000uL * round_MHz(average_MHz(currentcpu))));
+    {
+      long package = package_id(currentcpu);
+
+      if (frequencies.find(package) == frequencies.end())
+      {
+        float MHz = reported_MHz(currentcpu, maxi);
+
+        if (MHz <= 0)                             // last resort: calibrate once
+          MHz = estimate_MHz(currentcpu, 50000);
+        frequencies[package] = MHz;
+      }
+      cpu->setSize((unsigned long long) (1000000uL * round_MHz(frequencies[package])));
+    }
 
     currentcpu++;
   }
 
+  cpuid_close();
+
   return true;
 }
 
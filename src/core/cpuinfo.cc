@@ -1,6 +1,7 @@
 #include "version.h"
 #include "cpuinfo.h"
 #include "osutils.h"
+#include "context.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -11,7 +12,23 @@
 
 __ID("@(#) $Id$");
 
-static int currentcpu = 0;
+struct cpuinfo_state
+{
+  cpuinfo_state(): currentcpu(0), cpusdetected(0), cpusactive(0), siblings(-1) {}
+
+  int currentcpu;
+  int cpusdetected, cpusactive;                   // alpha
+  int siblings;                                   // x86
+  vector <string> s390x_features;
+  string s390x_vendor;
+  vector <string> aarch64_features;
+  string aarch64_processor_name;
+};
+
+static cpuinfo_state & state()
+{
+  return context().state<cpuinfo_state>();
+}
 
 static inline bool is_system_ppc_ibm(hwNode & node)
 {
@@ -67,14 +84,14 @@ int n = 0)
 static void cpuinfo_ppc_ibm(hwNode & node,
 			    const string & description, const string & version)
 {
-  hwNode *cpu = getcpu(node, currentcpu);
+  hwNode *cpu = getcpu(node, state().currentcpu);
 
   while (cpu)
   {
     cpu->setDescription(description);
     cpu->setVersion(version);
 
-    cpu = getcpu(node, ++currentcpu);
+    cpu = getcpu(node, ++state().currentcpu);
   }
 }
 
@@ -83,9 +100,9 @@ string id,
 string value)
 {
   if (id == "processor")
-    currentcpu++;
+    state().currentcpu++;
 
-  hwNode *cpu = getcpu(node, currentcpu);
+  hwNode *cpu = getcpu(node, state().currentcpu);
 
   if (cpu)
   {
@@ -105,8 +122,6 @@ string value)
   }
 }
 
-static vector <string> s390x_features;
-static string s390x_vendor;
 static void cpuinfo_s390x(hwNode & node,
 string id,
 string value)
@@ -117,7 +132,7 @@ string value)
         {
           size_t pos = value.find(' ');
           string capability = (pos==string::npos)?value:value.substr(0, pos);
-          s390x_features.push_back(capability);
+          state().s390x_features.push_back(capability);
           if (pos == string::npos)
             value = "";
           else
@@ -126,20 +141,20 @@ string value)
     }
 
   if (id == "vendor_id")
-    s390x_vendor = value;
+    state().s390x_vendor = value;
 
   if (matches(id, "^processor"))
-    currentcpu++;
+    state().currentcpu++;
 
-  hwNode *cpu = getcpu(node, currentcpu);
+  hwNode *cpu = getcpu(node, state().currentcpu);
   if (cpu)
     {
       cpu->addHint("logo", string("s390x"));
       cpu->claim(true);
-      cpu->setVendor(s390x_vendor);
+      cpu->setVendor(state().s390x_vendor);
 
-      for(size_t i=0; i < s390x_features.size(); i++)
-        cpu->addCapability(s390x_features[i]);
+      for(size_t i=0; i < state().s390x_features.size(); i++)
+        cpu->addCapability(state().s390x_features[i]);
       /* many thanks to Martin Schwidefsky for communicating the descriptions
          of the feature flags
       */
@@ -163,9 +178,9 @@ static void cpuinfo_arm(hwNode & node,
 {
 
   if (id.substr(0, string("processor").size())=="processor")
-    currentcpu++;
+    state().currentcpu++;
 
-  hwNode *cpu = getcpu(node, currentcpu);
+  hwNode *cpu = getcpu(node, state().currentcpu);
   if (cpu)
     {
       cpu->addHint("logo", string("arm"));
@@ -216,8 +231,6 @@ static void cpuinfo_arm(hwNode & node,
     }
 }
 
-static vector <string> aarch64_features;
-static string aarch64_processor_name;
 static void cpuinfo_aarch64(hwNode & node,
                         string id,
                         string value)
@@ -234,35 +247,35 @@ static void cpuinfo_aarch64(hwNode & node,
     return;
 
   if (id.substr(0, string("processor").size())=="processor")
-    currentcpu++;
+    state().currentcpu++;
 
   if (id.substr(0, string("Processor").size())=="Processor")
-    aarch64_processor_name = value;
+    state().aarch64_processor_name = value;
 
   if (id == "Features")
     {
-      hwNode *cpu = getcpu(node, currentcpu);
+      hwNode *cpu = getcpu(node, state().currentcpu);
       if (cpu)
         {
           cpu->addHint("logo", string("aarch64"));
           if (node.getDescription() == "")
-            node.setDescription(aarch64_processor_name);
+            node.setDescription(state().aarch64_processor_name);
           cpu->claim(true);
 
           while (value.length() > 0)
             {
               size_t pos = value.find(' ');
               string capability = (pos==string::npos)?value:value.substr(0, pos);
-              aarch64_features.push_back(capability);
+              state().aarch64_features.push_back(capability);
               if (pos == string::npos)
                 value = "";
               else
                 value = hw::strip(value.substr(pos));
             }
 
-          for(size_t i=0; i < aarch64_features.size(); i++)
+          for(size_t i=0; i < state().aarch64_features.size(); i++)
             {
-              cpu->addCapability(aarch64_features[i]);
+              cpu->addCapability(state().aarch64_features[i]);
               cpu->describeCapability("fp", "Floating point instructions");
               cpu->describeCapability("asimd", "Advanced SIMD");
               cpu->describeCapability("evtstrm", "Event stream");
@@ -282,9 +295,9 @@ string value)
 {
 
   if (id == "processor")
-    currentcpu++;
+    state().currentcpu++;
 
-  hwNode *cpu = getcpu(node, currentcpu);
+  hwNode *cpu = getcpu(node, state().currentcpu);
 
   if (cpu)
   {
@@ -296,7 +309,7 @@ string value)
 
       physicalcpu = atoi(value.c_str());
 
-      if (physicalcpu != currentcpu)
+      if (physicalcpu != state().currentcpu)
       {
         cpu->addCapability("emulated");
         cpu->addCapability("hyperthreading");
@@ -331,9 +344,9 @@ string id,
 string value)
 {
   if (id == "processor")
-    currentcpu++;
+    state().currentcpu++;
 
-  hwNode *cpu = getcpu(node, currentcpu);
+  hwNode *cpu = getcpu(node, state().currentcpu);
 
   if (id == "model" && node.getProduct() == "")
     node.setProduct(value);
@@ -364,8 +377,8 @@ static void cpuinfo_alpha(hwNode & node,
 string id,
 string value)
 {
-  static int cpusdetected = 0;
-  static int cpusactive = 0;
+  int & cpusdetected = state().cpusdetected;
+  int & cpusactive = state().cpusactive;
   unsigned long long frequency = 0;
   int i;
 
@@ -422,9 +435,9 @@ static void cpuinfo_x86(hwNode & node,
 string id,
 string value)
 {
-  static int siblings = -1;
+  int & siblings = state().siblings;
 
-  if(currentcpu < 0) siblings = -1;
+  if(state().currentcpu < 0) siblings = -1;
 
   if ((siblings<0) && (id == "siblings"))
   {
@@ -439,10 +452,10 @@ string value)
     if(siblings >= 0)
       return;
     else
-      currentcpu++;
+      state().currentcpu++;
   }
 
-  hwNode *cpu = getcpu(node, currentcpu);
+  hwNode *cpu = getcpu(node, state().currentcpu);
 
   if (cpu)
   {
@@ -583,7 +596,7 @@ string value)
 bool scan_cpuinfo(hwNode & n)
 {
   hwNode *core = n.getChild("core");
-  int cpuinfo = open("/proc/cpuinfo", O_RDONLY);
+  int cpuinfo = open_file("/proc/cpuinfo", O_RDONLY);
 
   if (cpuinfo < 0)
     return false;
@@ -611,7 +624,7 @@ bool scan_cpuinfo(hwNode & n)
     vector < string > cpuinfo_lines;
     splitlines(cpuinfo_str, cpuinfo_lines);
     cpuinfo_str = "";                             // free memory
-    currentcpu = -1;
+    state().currentcpu = -1;
 
     for (unsigned int i = 0; i < cpuinfo_lines.size(); i++)
     {
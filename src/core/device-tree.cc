@@ -15,6 +15,7 @@
 #include "device-tree.h"
 #include "osutils.h"
 #include "jedec.h"
+#include "context.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <arpa/inet.h>
@@ -35,6 +36,18 @@ __ID("@(#) $Id$");
 #define DIMMINFOSIZE 0x200
 typedef uint8_t dimminfo_buf[DIMMINFOSIZE];
 
+struct devtree_state
+{
+  devtree_state(): threads_per_cpu(0) {}
+
+  int threads_per_cpu;
+};
+
+static devtree_state & state()
+{
+  return context().state<devtree_state>();
+}
+
 struct dimminfo
 {
   uint8_t version3;
@@ -52,7 +65,7 @@ struct dimminfo
 static uint32_t get_u32(const string & path)
 {
   uint32_t result = 0;
-  int fd = open(path.c_str(), O_RDONLY);
+  int fd = open_file(path, O_RDONLY);
 
   if (fd >= 0)
   {
@@ -103,7 +116,7 @@ static vector < reg_entry > get_reg_property(const string & node)
   if (num_address_cells > 2 || num_size_cells > 2)
     return result;
 
-  FILE *f = fopen((node + "/reg").c_str(), "r");
+  FILE *f = fopen_file(node + "/reg");
   if (f == NULL)
     return result;
 
@@ -130,7 +143,7 @@ unsigned int offset = 0)
   char *strings = NULL;
   char *curstring = NULL;
 
-  int fd = open(path.c_str(), O_RDONLY);
+  int fd = open_file(path, O_RDONLY);
 
   if (fd >= 0)
   {
@@ -268,7 +281,7 @@ static void scan_devtree_firmware_powernv(hwNode & core)
     return;
 
   pushd(DEVICETREE "/ibm,firmware-versions");
-  n = scandir(".", &namelist, selectfile, alphasort);
+  n = scan_dir(".", &namelist, selectfile);
   popd();
 
   if (n <= 0)
@@ -351,7 +364,7 @@ static void scan_devtree_cpu(hwNode & core)
   int currentcpu=0;
 
   pushd(DEVICETREE "/cpus");
-  n = scandir(".", &namelist, selectdir, alphasort);
+  n = scan_dir(".", &namelist, selectdir);
   popd();
   if (n < 0)
     return;
@@ -402,7 +415,7 @@ static void scan_devtree_cpu(hwNode & core)
       }
 
       pushd(basepath);
-      ncache = scandir(".", &cachelist, selectdir, alphasort);
+      ncache = scan_dir(".", &cachelist, selectdir);
       popd();
       if (ncache > 0)
       {
@@ -484,7 +497,7 @@ static void add_chip_vpd(string path, string name,
     }
   }
 
-  n = scandir(".", &dirlist, selectdir, alphasort);
+  n = scan_dir(".", &dirlist, selectdir);
   popd();
 
   if (n <= 0)
@@ -509,7 +522,7 @@ static void scan_chip_vpd(map <uint32_t, chip_vpd_data *> & vpd)
     return;
 
   pushd(DEVICETREEVPD);
-  n = scandir(".", &namelist, selectdir, alphasort);
+  n = scan_dir(".", &namelist, selectdir);
   popd();
 
   if (n <= 0)
@@ -572,7 +585,7 @@ static void fill_core_vpd(hwNode & cpu, string & basepath,
 
 static void set_cpu_config_threads(hwNode & cpu, const string & basepath)
 {
-  static int threads_per_cpu = 0;
+  int & threads_per_cpu = state().threads_per_cpu;
 
   /* In power systems, there are equal no. of threads per cpu-core */
   if (threads_per_cpu == 0)
@@ -587,7 +600,7 @@ static void set_cpu_config_threads(hwNode & cpu, const string & basepath)
      * in bytes of a file. Hence, grouping by 4 bytes, we get the thread
      * count.
      */
-    rc = stat(p.c_str(), &sbuf);
+    rc = stat_file(p, &sbuf);
     if (!rc)
       threads_per_cpu = sbuf.st_size / 4;
   }
@@ -602,7 +615,7 @@ static void scan_xscom_node(map <uint32_t, string> & xscoms)
   struct dirent **namelist;
 
   pushd(DEVICETREE);
-  n = scandir(".", &namelist, selectdir, alphasort);
+  n = scan_dir(".", &namelist, selectdir);
   popd();
 
   if (n <= 0)
@@ -635,7 +648,7 @@ static void scan_devtree_cpu_power(hwNode & core)
   map <uint32_t, string> xscoms;
 
   pushd(DEVICETREE "/cpus");
-  n = scandir(".", &namelist, selectdir, alphasort);
+  n = scan_dir(".", &namelist, selectdir);
   popd();
   if (n < 0)
     return;
@@ -823,7 +836,7 @@ static bool add_memory_bank_mba_dimm(string path,
   struct dirent **namelist;
 
   pushd(path);
-  n = scandir(".", &namelist, selectdir, alphasort);
+  n = scan_dir(".", &namelist, selectdir);
   popd();
 
   if (n < 0)
@@ -882,7 +895,7 @@ static void add_memory_bank_spd(string path, hwNode & bank)
   size_t len = 0;
   dimminfo_buf dimminfo;
 
-  fd = open(path.c_str(), O_RDONLY);
+  fd = open_file(path, O_RDONLY);
   if (fd < 0)
     return;
 
@@ -1109,7 +1122,7 @@ static void add_memory_bank(string name, string path, hwNode & core)
     memory->addChild(bank);
   }
 
-  n = scandir(".", &dirlist, selectdir, alphasort);
+  n = scan_dir(".", &dirlist, selectdir);
   popd();
 
   if (n < 0)
@@ -1131,7 +1144,7 @@ static void scan_devtree_memory_powernv(hwNode & core)
   string path = DEVICETREEVPD;
 
   pushd(DEVICETREEVPD);
-  n = scandir(".", &namelist, selectdir, alphasort);
+  n = scan_dir(".", &namelist, selectdir);
   popd();
 
   if (n < 0)
@@ -1152,7 +1165,7 @@ static void scan_devtree_memory_ibm(hwNode & core)
 {
   struct dirent **namelist;
   pushd(DEVICETREE);
-  int n = scandir(".", &namelist, selectdir, alphasort);
+  int n = scan_dir(".", &namelist, selectdir);
   popd();
 
   if (n < 0)
@@ -39,7 +39,7 @@ bool scan_disk(hwNode & n)
   if (n.getLogicalName() == "")
     return false;
 
-  int fd = open(n.getLogicalName().c_str(), O_RDONLY | O_NONBLOCK);
+  int fd = open_file(n.getLogicalName(), O_RDONLY | O_NONBLOCK);
 
   if (fd < 0)
     return false;
@@ -79,10 +79,10 @@
 #include "options.h"
 #include "dmi.h"
 #include "osutils.h"
+#include "context.h"
 
 #include <map>
 #include <vector>
-#include <fstream>
 
 #include <stdint.h>
 #include <stdio.h>
@@ -96,7 +96,17 @@ __ID("@(#) $Id$");
 
 #define SYSFSDMI "/sys/firmware/dmi/tables"
 
-static int currentcpu = 0;
+struct dmi_state
+{
+  dmi_state(): currentcpu(0) {}
+
+  int currentcpu;
+};
+
+static dmi_state & state()
+{
+  return context().state<dmi_state>();
+}
 
 typedef uint8_t u8;
 typedef uint16_t u16;
@@ -1142,7 +1152,7 @@ int dmiversionrev)
             hw::processor);
 
           newnode.claim();
-          newnode.setBusInfo(cpubusinfo(currentcpu++));
+          newnode.setBusInfo(cpubusinfo(state().currentcpu++));
           newnode.setSlot(dmi_string(dm, data[0x04]));
           newnode.setDescription(_("CPU"));
           newnode.addHint("icon", string("cpu"));
@@ -1914,36 +1924,24 @@ static bool smbios_entry_point(const u8 *buf, size_t len,
 
 static bool scan_dmi_sysfs(hwNode & n)
 {
-  if (access(SYSFSDMI "/smbios_entry_point", R_OK)!=0 || access(SYSFSDMI "/DMI", R_OK)!=0)
+  if (!exists(SYSFSDMI "/smbios_entry_point") || !exists(SYSFSDMI "/DMI"))
     return false;
 
   uint32_t table_len = 0;
   uint64_t table_base = 0;
   u16 dmimaj = 0, dmimin = 0, dmirev = 0;
 
-  ifstream ep_stream(SYSFSDMI "/smbios_entry_point",
-      ifstream::in | ifstream::binary | ifstream::ate);
-  if (!ep_stream)
-    return false;
-  ifstream::pos_type ep_len = ep_stream.tellg();
-  vector < u8 > ep_buf(ep_len);
-  ep_stream.seekg(0, ifstream::beg);
-  ep_stream.read((char *)ep_buf.data(), ep_len);
-  if (!ep_stream)
+  string ep_buf = get_string(SYSFSDMI "/smbios_entry_point");
+  if (ep_buf.empty())
     return false;
-  if (!smbios_entry_point(ep_buf.data(), ep_len, n,
+  if (!smbios_entry_point((const u8 *)ep_buf.data(), ep_buf.length(), n,
         dmimaj, dmimin, dmirev, table_len, table_base))
     return false;
 
-  ifstream dmi_stream(SYSFSDMI "/DMI",
-      ifstream::in | ifstream::binary | ifstream::ate);
-  ifstream::pos_type dmi_len = dmi_stream.tellg();
-  vector < u8 > dmi_buf(dmi_len);
-  dmi_stream.seekg(0, ifstream::beg);
-  dmi_stream.read((char *)dmi_buf.data(), dmi_len);
-  if (!dmi_stream)
+  string dmi_buf = get_string(SYSFSDMI "/DMI");
+  if (dmi_buf.empty())
     return false;
-  dmi_table(dmi_buf.data(), dmi_len, n, dmimaj, dmimin, dmirev);
+  dmi_table((const u8 *)dmi_buf.data(), dmi_buf.length(), n, dmimaj, dmimin, dmirev);
 
   return true;
 }
@@ -1975,7 +1973,7 @@ long get_efi_systab_smbios()
 static bool scan_dmi_devmem(hwNode & n)
 {
   unsigned char buf[31];
-  int fd = open("/dev/mem",
+  int fd = open_file("/dev/mem",
     O_RDONLY);
   long fp = get_efi_systab_smbios();
   u32 mmoffset = 0;
@@ -176,7 +176,7 @@ static int lookup_dev(const char *name)
   int n;
   char s[32], t[32];
 
-  f = fopen("/proc/devices", "r");
+  f = fopen_file("/proc/devices");
   if (f == NULL)
     return -errno;
   while (fgets(s, 32, f) != NULL)
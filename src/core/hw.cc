@@ -9,7 +9,10 @@
 #include "db.h"
 #include <cstring>
 #include <vector>
+#include <deque>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <sstream>
 #include <stdlib.h>
 #include <stdio.h>
@@ -24,8 +27,14 @@ using namespace hw;
 
 __ID("@(#) $Id$");
 
+struct hwNode_index;
+
 struct hwNode_i
 {
+  hwNode_i *parent;
+  hwNode *self;                                   // the hwNode owning this
+  unsigned int rank;                              // position in parent
+  hwNode_index *index;                            // only built at the root
   hwClass deviceclass;
   string id, vendor, product, version, date, serial, slot, handle, description,
     businfo, physid, dev, modalias, subvendor, subproduct;
@@ -36,7 +45,7 @@ struct hwNode_i
   unsigned long long capacity;
   unsigned long long clock;
   unsigned int width;
-  vector < hwNode > children;
+  deque < hwNode > children;                      // stable addresses
   vector < string > attracted;
   vector < string > features;
   vector < string > logicalnames;
@@ -46,6 +55,119 @@ struct hwNode_i
   map < string, value > hints;
 };
 
+/*
+ * lookup tables used by findChildByHandle(), findChildByBusInfo(),
+ * findChildByLogicalName() and attractsHandle(): they are built on demand at
+ * the root of a tree and then kept up to date by addChild(), setHandle(),
+ * setBusInfo(), setLogicalName() and attractHandle()
+ */
+struct hwNode_index
+{
+  typedef unordered_map < string, vector < hwNode_i * > > table;
+
+  table handles;
+  table businfos;
+  table logicalnames;
+  table attracted;
+
+  void add(hwNode_i * n);
+  static hwNode *find(hwNode_i * n, table hwNode_index::* t, const string & key);
+};
+
+static hwNode_i *getroot(hwNode_i * n)
+{
+  while (n->parent)
+    n = n->parent;
+
+  return n;
+}
+
+
+static string businfokey(const string & businfo);
+
+static void index_add(hwNode_index::table & t,
+const string & key,
+hwNode_i * n)
+{
+  if (key != "")
+    t[key].push_back(n);
+}
+
+
+static void index_remove(hwNode_index::table & t,
+const string & key,
+hwNode_i * n)
+{
+  hwNode_index::table::iterator i = t.find(key);
+
+  if (i == t.end())
+    return;
+
+  for (size_t j = 0; j < i->second.size(); j++)
+    if (i->second[j] == n)
+    {
+      i->second.erase(i->second.begin() + j);
+      break;
+    }
+
+  if (i->second.empty())
+    t.erase(i);
+}
+
+
+static void reindex(hwNode_i * n,
+hwNode_index::table hwNode_index::* t,
+const string & oldkey,
+const string & newkey)
+{
+  hwNode_index *index = getroot(n)->index;
+
+  if (!index || (oldkey == newkey))
+    return;
+
+  index_remove(index->*t, oldkey, n);
+  index_add(index->*t, newkey, n);
+}
+
+
+static void dropindex(hwNode_i * n)
+{
+  hwNode_i *root = getroot(n);
+
+  delete root->index;
+  root->index = NULL;
+}
+
+
+// does a come before b in a depth-first walk of the tree?
+static bool precedes(hwNode_i * a,
+hwNode_i * b)
+{
+  vector < hwNode_i * > patha, pathb;
+
+  for (; a; a = a->parent)
+    patha.insert(patha.begin(), a);
+  for (; b; b = b->parent)
+    pathb.insert(pathb.begin(), b);
+
+  for (size_t i = 0; (i < patha.size()) && (i < pathb.size()); i++)
+    if (patha[i] != pathb[i])
+      return patha[i]->rank < pathb[i]->rank;
+
+  return patha.size() < pathb.size();             // ancestors come first
+}
+
+
+static bool isdescendant(hwNode_i * n,
+hwNode_i * ancestor)
+{
+  for (; n; n = n->parent)
+    if (n == ancestor)
+      return true;
+
+  return false;
+}
+
 string hw::strip(const string & s)
 {
   string result = s;
@@ -79,6 +201,12 @@ string hw::asString(long n)
   return string(buffer);
 }
 
+static string businfokey(const string & businfo)
+{
+  return lowercase(strip(businfo));
+}
+
+
 static string cleanupId(const string & id)
 {
   string result = strip(id);
@@ -105,6 +233,10 @@ const string & product, const string & version)
   if (!This)
     return;
 
+  This->parent = NULL;
+  This->self = this;
+  This->rank = 0;
+  This->index = NULL;
   This->deviceclass = c;
   This->id = cleanupId(id);
   This->vendor = strip(vendor);
@@ -135,23 +267,47 @@ hwNode::hwNode(const hwNode & o)
 
   if (o.This)
     (*This) = (*o.This);
+  attach(NULL);
+}
+
+
+hwNode::hwNode(hwNode && o) noexcept
+{
+  This = o.This;
+  o.This = NULL;
+
+  if (This)
+    This->self = this;
 }
 
 
 hwNode::~hwNode()
 {
   if (This)
+  {
+    delete This->index;
     delete This;
+  }
 }
 
 
 hwNode & hwNode::operator = (const hwNode & o)
 {
+  hwNode_i *parent = NULL;
+  unsigned int rank = 0;
+
   if (this == &o)
     return *this;                                 // self-affectation
 
   if (This)
+  {
+    parent = This->parent;
+    rank = This->rank;
+    if (parent)
+      dropindex(parent);                          // the whole subtree is replaced
+    delete This->index;
     delete This;
+  }
   This = NULL;
   This = new hwNode_i;
 
@@ -160,11 +316,77 @@ hwNode & hwNode::operator = (const hwNode & o)
 
   if (o.This)
     (*This) = (*o.This);
+  attach(parent);
+  This->rank = rank;
 
   return *this;
 }
 
 
+// fix links after this node has been copied from another one
+void hwNode::attach(hwNode_i * parent)
+{
+  if (!This)
+    return;
+
+  This->parent = parent;
+  This->self = this;
+  This->index = NULL;
+
+  for (unsigned int i = 0; i < This->children.size(); i++)
+    if (This->children[i].This)
+    {
+      This->children[i].This->parent = This;
+      This->children[i].This->rank = i;
+    }
+}
+
+
+void hwNode_index::add(hwNode_i * n)
+{
+  index_add(handles, n->handle, n);
+  index_add(businfos, businfokey(n->businfo), n);
+  for (unsigned int i = 0; i < n->logicalnames.size(); i++)
+    index_add(logicalnames, n->logicalnames[i], n);
+  for (unsigned int i = 0; i < n->attracted.size(); i++)
+    index_add(attracted, n->attracted[i], n);
+
+  for (unsigned int i = 0; i < n->children.size(); i++)
+    if (n->children[i].This)
+      add(n->children[i].This);
+}
+
+
+hwNode *hwNode_index::find(hwNode_i * n,
+table hwNode_index::* t,
+const string & key)
+{
+  hwNode_i *root = NULL;
+  hwNode_i *result = NULL;
+
+  if (!n || (key == ""))
+    return NULL;
+
+  root = getroot(n);
+  if (!root->index)
+  {
+    root->index = new hwNode_index;
+    root->index->add(root);
+  }
+
+  table::iterator i = (root->index->*t).find(key);
+  if (i == (root->index->*t).end())
+    return NULL;
+
+  for (size_t j = 0; j < i->second.size(); j++)
+    if (isdescendant(i->second[j], n) &&
+      (!result || precedes(i->second[j], result)))
+      result = i->second[j];
+
+  return result?result->self:NULL;
+}
+
+
 hwClass hwNode::getClass() const
 {
   if (This)
@@ -354,6 +576,7 @@ void hwNode::setHandle(const string & handle)
   if (!This)
     return;
 
+  reindex(This, &hwNode_index::handles, This->handle, handle);
   This->handle = handle;
 }
 
@@ -630,7 +853,7 @@ hwNode *hwNode::getChildByPhysId(const string & physid)
 
   for (unsigned int i = 0; i < This->children.size(); i++)
   {
-    if (This->children[i].getPhysId() == physid)
+    if (This->children[i].This && (This->children[i].This->physid == physid))
       return &(This->children[i]);
   }
 
@@ -672,8 +895,9 @@ hwNode *hwNode::getChild(const string & id)
       path = id.substr(pos + 1);
   }
 
+  baseid = cleanupId(baseid);
   for (unsigned int i = 0; i < This->children.size(); i++)
-    if (This->children[i].getId() == cleanupId(baseid))
+    if (This->children[i].getId() == baseid)
   {
     if (path == "")
       return &(This->children[i]);
@@ -709,6 +933,9 @@ hwNode *hwNode::findChildByHandle(const string & handle)
   if (!This)
     return NULL;
 
+  if (handle != "")
+    return hwNode_index::find(This, &hwNode_index::handles, handle);
+
   if (This->handle == handle)
     return this;
 
@@ -726,24 +953,7 @@ hwNode *hwNode::findChildByHandle(const string & handle)
 
 hwNode *hwNode::findChildByLogicalName(const string & name)
 {
-  unsigned int i = 0;
-
-  if (!This)
-    return NULL;
-
-  for (i = 0; i < This->logicalnames.size(); i++)
-    if (This->logicalnames[i] == name)
-      return this;
-
-  for (i = 0; i < This->children.size(); i++)
-  {
-    hwNode *result = This->children[i].findChildByLogicalName(name);
-
-    if (result)
-      return result;
-  }
-
-  return NULL;
+  return hwNode_index::find(This, &hwNode_index::logicalnames, name);
 }
 
 
@@ -755,18 +965,7 @@ hwNode *hwNode::findChildByBusInfo(const string & businfo)
   if (strip(businfo) == "")
     return NULL;
 
-  if (lowercase(strip(This->businfo)) == lowercase(strip(businfo)))
-    return this;
-
-  for (unsigned int i = 0; i < This->children.size(); i++)
-  {
-    hwNode *result = This->children[i].findChildByBusInfo(businfo);
-
-    if (result)
-      return result;
-  }
-
-  return NULL;
+  return hwNode_index::find(This, &hwNode_index::businfos, businfokey(businfo));
 }
 
 
@@ -802,19 +1001,26 @@ int count)
 
 
 hwNode *hwNode::addChild(const hwNode & node)
+{
+  return addChild(hwNode(node));
+}
+
+
+hwNode *hwNode::addChild(hwNode && node)
 {
   hwNode *existing = NULL;
   hwNode *samephysid = NULL;
   string id = node.getId();
   int count = 0;
 
-  if (!This)
+  if (!This || !node.This)
     return NULL;
 
 // first see if the new node is attracted by one of our children
-  for (unsigned int i = 0; i < This->children.size(); i++)
-    if (This->children[i].attractsNode(node))
-      return This->children[i].addChild(node);
+  if (attractsNode(node))
+    for (unsigned int i = 0; i < This->children.size(); i++)
+      if (This->children[i].attractsNode(node))
+        return This->children[i].addChild(std::move(node));
 
 // find if another child already has the same physical id
 // in that case, we remove BOTH physical ids and let auto-allocation proceed
@@ -825,25 +1031,63 @@ hwNode *hwNode::addChild(const hwNode & node)
     samephysid->setPhysId("");
   }
 
-  existing = getChild(id);
+// collect the numbers already taken by children named id:<n> in one pass,
+// instead of looking each candidate name up among all the children (the
+// lowest free numbers can't be above the number of children)
+  string prefix = id + ":";
+  vector < bool > taken(This->children.size() + 2, false);
+  for (unsigned int i = 0; i < This->children.size(); i++)
+  {
+    if (!This->children[i].This)
+      continue;
+
+    const string & childid = This->children[i].This->id;
+
+    if (childid == id)
+    {
+      if (!existing)
+        existing = &(This->children[i]);
+    }
+    else if (childid.compare(0, prefix.length(), prefix) == 0)
+    {
+      size_t digits = childid.length() - prefix.length();
+
+      if ((digits > 0) && (digits <= 9) &&
+        (childid.find_first_not_of("0123456789", prefix.length()) == string::npos) &&
+        ((digits == 1) || (childid[prefix.length()] != '0')))
+      {
+        unsigned long n = strtoul(childid.c_str() + prefix.length(), NULL, 10);
+
+        if (n < taken.size())
+          taken[n] = true;
+      }
+    }
+  }
+
   if (existing)                                   // first rename existing instance
   {
-    while (getChild(generateId(id, count)))       // find a usable name
+    while (taken[count])                          // find a usable name
       count++;
 
     existing->setId(generateId(id, count));       // rename
+    taken[count] = true;
   }
 
-  while (getChild(generateId(id, count)))
+  while (taken[count])
     count++;
 
-  This->children.push_back(node);
-  if (existing || getChild(generateId(id, 0)))
+  This->children.push_back(std::move(node));
+  This->children.back().This->parent = This;
+  This->children.back().This->rank = This->children.size() - 1;
+  if (existing || taken[0])
     This->children.back().setId(generateId(id, count));
 
   if (samephysid)
     This->children.back().setPhysId("");
 
+  if (getroot(This)->index)
+    getroot(This)->index->add(This->children.back().This);
+
   return &(This->children.back());
 //return getChild(This->children.back().getId());
 }
@@ -855,24 +1099,16 @@ void hwNode::attractHandle(const string & handle)
     return;
 
   This->attracted.push_back(handle);
+  reindex(This, &hwNode_index::attracted, "", handle);
 }
 
 
 bool hwNode::attractsHandle(const string & handle) const
 {
-  unsigned int i = 0;
   if (handle == "" || !This)
     return false;
 
-  for (i = 0; i < This->attracted.size(); i++)
-    if (This->attracted[i] == handle)
-      return true;
-
-  for (i = 0; i < This->children.size(); i++)
-    if (This->children[i].attractsHandle(handle))
-      return true;
-
-  return false;
+  return hwNode_index::find(This, &hwNode_index::attracted, handle) != NULL;
 }
 
 
@@ -1087,6 +1323,7 @@ void hwNode::setLogicalName(const string & name)
     }
     else
       This->logicalnames.push_back((n[0]=='/')?n:shortname(n));
+    reindex(This, &hwNode_index::logicalnames, "", This->logicalnames.back());
 
     if(This->dev == "")
       This->dev = get_devid(n);
@@ -1135,10 +1372,13 @@ void hwNode::setBusInfo(const string & businfo)
 {
   if (This)
   {
+    string oldkey = businfokey(This->businfo);
+
     if (businfo.find('@') != string::npos)
       This->businfo = strip(businfo);
     else
       This->businfo = guessBusInfo(strip(businfo));
+    reindex(This, &hwNode_index::businfos, oldkey, businfokey(This->businfo));
   }
 }
 
@@ -1211,19 +1451,28 @@ void hwNode::assignPhysIds()
   if (!This)
     return;
 
+// physical ids in use; ids only get taken, so the search for a free one can
+// resume where the previous one stopped
+  unordered_set < string > physids;
+  long next[2] = { 0, 0x100 };
+
   for (unsigned int i = 0; i < This->children.size(); i++)
-  {
-    long curid = 0;
+    physids.insert(This->children[i].getPhysId());
 
-    if (This->children[i].getClass() == hw::bridge)
-      curid = 0x100;
+  for (unsigned int i = 0; i < This->children.size(); i++)
+  {
+    long & curid = next[This->children[i].getClass() == hw::bridge];
 
     if (This->children[i].getPhysId() == "")
     {
-      while (getChildByPhysId(curid))
-        curid++;
+      char buffer[20];
+
+      snprintf(buffer, sizeof(buffer), "%lx", curid);
+      while (physids.count(buffer))
+        snprintf(buffer, sizeof(buffer), "%lx", ++curid);
 
       This->children[i].setPhysId(curid);
+      physids.insert(This->children[i].getPhysId());
     }
 
     This->children[i].assignPhysIds();
@@ -1284,13 +1533,19 @@ void hwNode::merge(const hwNode & node)
   if (node.claimed())
     claim();
   if (This->handle == "")
+  {
+    reindex(This, &hwNode_index::handles, "", node.getHandle());
     This->handle = node.getHandle();
+  }
   if (This->description == "")
     This->description = node.getDescription();
   for (unsigned int i = 0; i < node.This->logicalnames.size(); i++)
     setLogicalName(node.This->logicalnames[i]);
   if (This->businfo == "")
+  {
+    reindex(This, &hwNode_index::businfos, "", businfokey(node.getBusInfo()));
     This->businfo = node.getBusInfo();
+  }
   if (This->physid == "")
     This->physid = node.getPhysId();
 
@@ -1392,659 +1647,1046 @@ vector < string > hwNode::getHints() const
   return result;
 }
 
-string hwNode::asJSON(unsigned level)
+/*
+ * Serialisation: walk() visits the tree depth-first and hands every node
+ * to a treewriter, which streams its format straight to the output.
+ * Nodes whose class isn't visible (see -class) are skipped but their
+ * children are still visited, at level 1.
+ */
+class treewriter
 {
-  vector < string > config;
-  vector < string > resources;
-  ostringstream out;
+  public:
+    virtual ~treewriter() {}
 
-  if(!This) return "";
+    virtual void begin(hwNode &, unsigned) = 0;
+    virtual void beginchildren(hwNode &, unsigned) {}
+    virtual void separator() {}
+    virtual void endchildren(hwNode &, unsigned) {}
+    virtual void end(hwNode &, unsigned) = 0;
+};
 
-  config = getConfigKeys();
-  resources = getResources("\" value=\"");
+static void walk(hwNode & n, treewriter & writer, unsigned level, unsigned step)
+{
+  bool shown = visible(n.getClassName());
 
-  if (::enabled("output:list") && level == 0)
-  {
-    out << "[" << endl;
-  }
+  if(shown)
+    writer.begin(n, level);
 
-  if(visible(getClassName()))
+  if(n.countChildren() > 0)
   {
-    out << spaces(2*level) << "{" << endl;
-    out << spaces(2*level+2) << "\"id\" : \"" << getId() << "\"," << endl;
-    out << spaces(2*level+2) << "\"class\" : \"" << getClassName() << "\"";
-
-    if (disabled())
-      out << "," << endl << spaces(2*level+2) << "\"disabled\" : true";
-    if (claimed())
-      out << "," << endl << spaces(2*level+2) << "\"claimed\" : true";
-
-    if(getHandle() != "")
-      out << "," << endl << spaces(2*level+2) << "\"handle\" : \"" << getHandle() << "\"";
-
-    if (getDescription() != "")
+    writer.beginchildren(n, level);
+    for (unsigned int i = 0; i < n.countChildren(); i++)
     {
-      out << "," << endl;
-      out << spaces(2*level+2);
-      out << "\"description\" : \"";
-      out << escapeJSON(getDescription());
-      out << "\"";
+      if(i) writer.separator();
+      walk(*n.getChild(i), writer, shown ? level + step : 1, step);
     }
+    writer.endchildren(n, level);
+  }
 
-    if (getProduct() != "")
-    {
-      out << "," << endl;
-      out << spaces(2*level+2);
-      out << "\"product\" : \"";
-      out << escapeJSON(getProduct());
-      out << "\"";
-    }
+  if(shown)
+    writer.end(n, level);
+}
 
-    if (getVendor() != "")
-    {
-      out << "," << endl;
-      out << spaces(2*level+2);
-      out << "\"vendor\" : \"";
-      out << escapeJSON(getVendor());
-      out << "\"";
-    }
+/*
+ * in list mode (-class) nodes are written one after the other instead of
+ * being nested into their parent's "children"
+ */
+class jsonwriter: public treewriter
+{
+  public:
+    jsonwriter(ostream & o): out(o), list(::enabled("output:list")), first(true) {}
 
-    if (getPhysId() != "")
-    {
-      out << "," << endl;
-      out << spaces(2*level+2);
-      out << "\"physid\" : \"";
-      out << getPhysId();
-      out << "\"";
-    }
+    void begin(hwNode &, unsigned);
+    void beginchildren(hwNode &, unsigned);
+    void separator();
+    void endchildren(hwNode &, unsigned);
+    void end(hwNode &, unsigned);
 
-    if (getBusInfo() != "")
-    {
-      out << "," << endl;
-      out << spaces(2*level+2);
-      out << "\"businfo\" : \"";
-      out << escapeJSON(getBusInfo());
-      out << "\"";
-    }
+  private:
+    ostream & out;
+    bool list;
+    bool first;
 
-    if (getLogicalName() != "")
-    {
-      vector<string> logicalnames = getLogicalNames();
+    void close(unsigned level);
+};
 
-      out << "," << endl;
-      out << spaces(2*level+2);
-      out << "\"logicalname\" : ";
-      if(logicalnames.size() > 1)
-      {
-        out << "[";
-        for(unsigned int i = 0; i<logicalnames.size(); i++)
-        {
-          if(i) out << ", ";
-          out << "\"" << logicalnames[i] << "\"";
-        }
-        out << "]";
-      }
-      else
-        out << "\"" << escapeJSON(getLogicalName()) << "\"";
-    }
+void jsonwriter::begin(hwNode & n, unsigned level)
+{
+  vector < string > config;
+  vector < string > resources;
 
-    if (getDev() != "")
-    {
-      out << "," << endl;
-      out << spaces(2*level+2);
-      out << "\"dev\" : \"";
-      out << escapeJSON(getDev());
-      out << "\"";
-    }
+  config = n.getConfigKeys();
+  resources = n.getResources("\" value=\"");
 
-    if (getVersion() != "")
-    {
-      out << "," << endl;
-      out << spaces(2*level+2);
-      out << "\"version\" : \"";
-      out << escapeJSON(getVersion());
-      out << "\"";
-    }
+  if(list && !first)
+    out << "," << endl;
+  first = false;
 
-    if (getDate() != "")
-    {
-      out << "," << endl;
-      out << spaces(2*level+2);
-      out << "\"date\" : \"";
-      out << escapeJSON(getDate());
-      out << "\"";
-    }
+  out << spaces(2*level) << "{" << endl;
+  out << spaces(2*level+2) << "\"id\" : \"" << n.getId() << "\"," << endl;
+  out << spaces(2*level+2) << "\"class\" : \"" << n.getClassName() << "\"";
 
-    if (getSerial() != "")
-    {
-      out << "," << endl;
-      out << spaces(2*level+2);
-      out << "\"serial\" : \"";
-      out << (::enabled("output:sanitize")?REMOVED:escapeJSON(getSerial()));
-      out << "\"";
-    }
+  if (n.disabled())
+    out << "," << endl << spaces(2*level+2) << "\"disabled\" : true";
+  if (n.claimed())
+    out << "," << endl << spaces(2*level+2) << "\"claimed\" : true";
 
-    if (getSlot() != "")
-    {
-      out << "," << endl;
-      out << spaces(2*level+2);
-      out << "\"slot\" : \"";
-      out << escapeJSON(getSlot());
-      out << "\"";
-    }
+  if(n.getHandle() != "")
+    out << "," << endl << spaces(2*level+2) << "\"handle\" : \"" << n.getHandle() << "\"";
 
-    if ((getSize() > 0) || (getCapacity() > 0))
-      switch (getClass())
-      {
-        case hw::memory:
-        case hw::address:
-        case hw::storage:
-        case hw::disk:
-        case hw::display:
-          out << "," << endl << spaces(2*level+2) << "\"units\" : \"bytes\"";
-          break;
-
-        case hw::processor:
-        case hw::bus:
-        case hw::system:
-          out << "," << endl << spaces(2*level+2) << "\"units\" : \"Hz\"";
-          break;
-
-        case hw::power:
-          out << "," << endl << spaces(2*level+2) << "\"units\" : \"mWh\"";
-          break;
-
-        case hw::network:
-          out << "," << endl << spaces(2*level+2) << "\"units\" : \"bit/s\"";
-          break;
-
-        default:
-          break;
-      }
+  if (n.getDescription() != "")
+  {
+    out << "," << endl;
+    out << spaces(2*level+2);
+    out << "\"description\" : \"";
+    out << escapeJSON(n.getDescription());
+    out << "\"";
+  }
 
-    if (getSize() > 0)
-    {
-      out << "," << endl;
-      out << spaces(2*level+2);
-      out << "\"size\" : ";
-      out << getSize();
-    }
+  if (n.getProduct() != "")
+  {
+    out << "," << endl;
+    out << spaces(2*level+2);
+    out << "\"product\" : \"";
+    out << escapeJSON(n.getProduct());
+    out << "\"";
+  }
 
-    if (getCapacity() > 0)
-    {
-      out << "," << endl;
-      out << spaces(2*level+2);
-      out << "\"capacity\" : ";
-      out << getCapacity();
-    }
+  if (n.getVendor() != "")
+  {
+    out << "," << endl;
+    out << spaces(2*level+2);
+    out << "\"vendor\" : \"";
+    out << escapeJSON(n.getVendor());
+    out << "\"";
+  }
 
-    if (getWidth() > 0)
-    {
-      out << "," << endl;
-      out << spaces(2*level+2);
-      out << "\"width\" : ";
-      out << getWidth();
-    }
+  if (n.getPhysId() != "")
+  {
+    out << "," << endl;
+    out << spaces(2*level+2);
+    out << "\"physid\" : \"";
+    out << n.getPhysId();
+    out << "\"";
+  }
 
-    if (getClock() > 0)
-    {
-      out << "," << endl;
-      out << spaces(2*level+2);
-      out << "\"clock\" : ";
-      out << getClock();
-    }
+  if (n.getBusInfo() != "")
+  {
+    out << "," << endl;
+    out << spaces(2*level+2);
+    out << "\"businfo\" : \"";
+    out << escapeJSON(n.getBusInfo());
+    out << "\"";
+  }
 
-    if (config.size() > 0)
-    {
-      out << "," << endl;
-      out << spaces(2*level+2);
-      out << "\"configuration\" : {" << endl;
-      for (unsigned int j = 0; j < config.size(); j++)
-      {
-        if(j) out << "," << endl;
-        out << spaces(2*level+4);
-        out << "\"" << escapeJSON(config[j]) << "\" : \"" << escapeJSON(getConfig(config[j])) << "\"";
-      }
-      out << endl << spaces(2*level+2);
-      out << "}";
-    }
-    config.clear();
+  if (n.getLogicalName() != "")
+  {
+    vector<string> logicalnames = n.getLogicalNames();
 
-    splitlines(getCapabilities(), config, ' ');
-    if (config.size() > 0)
+    out << "," << endl;
+    out << spaces(2*level+2);
+    out << "\"logicalname\" : ";
+    if(logicalnames.size() > 1)
     {
-      out << "," << endl;
-      out << spaces(2*level+2);
-      out << "\"capabilities\" : {" << endl;
-      for (unsigned int j = 0; j < config.size(); j++)
+      out << "[";
+      for(unsigned int i = 0; i<logicalnames.size(); i++)
       {
-        if(j) out << "," << endl;
-        out << spaces(2*level+4);
-        out << "\"" << escapeJSON(config[j]) << "\" : ";
-        if (getCapabilityDescription(config[j]) == "")
-        {
-          out << "true";
-        }
-        else
-        {
-          out << "\"";
-          out << escapeJSON(getCapabilityDescription(config[j]));
-          out << "\"";
-        }
+        if(i) out << ", ";
+        out << "\"" << logicalnames[i] << "\"";
       }
-      out << endl << spaces(2*level+2);
-      out << "}";
+      out << "]";
     }
-    config.clear();
+    else
+      out << "\"" << escapeJSON(n.getLogicalName()) << "\"";
+  }
+
+  if (n.getDev() != "")
+  {
+    out << "," << endl;
+    out << spaces(2*level+2);
+    out << "\"dev\" : \"";
+    out << escapeJSON(n.getDev());
+    out << "\"";
+  }
+
+  if (n.getVersion() != "")
+  {
+    out << "," << endl;
+    out << spaces(2*level+2);
+    out << "\"version\" : \"";
+    out << escapeJSON(n.getVersion());
+    out << "\"";
+  }
+
+  if (n.getDate() != "")
+  {
+    out << "," << endl;
+    out << spaces(2*level+2);
+    out << "\"date\" : \"";
+    out << escapeJSON(n.getDate());
+    out << "\"";
+  }
+
+  if (n.getSerial() != "")
+  {
+    out << "," << endl;
+    out << spaces(2*level+2);
+    out << "\"serial\" : \"";
+    out << (::enabled("output:sanitize")?REMOVED:escapeJSON(n.getSerial()));
+    out << "\"";
+  }
+
+  if (n.getSlot() != "")
+  {
+    out << "," << endl;
+    out << spaces(2*level+2);
+    out << "\"slot\" : \"";
+    out << escapeJSON(n.getSlot());
+    out << "\"";
+  }
 
-    if (0 && resources.size() > 0)
+  if ((n.getSize() > 0) || (n.getCapacity() > 0))
+    switch (n.getClass())
     {
-      out << spaces(2*level+1);
-      out << "<resources>" << endl;
-      for (unsigned int j = 0; j < resources.size(); j++)
-      {
-        out << spaces(2*level+2);
-        out << "<resource type=\"" << escapeJSON(resources[j]) << "\" />";
-        out << endl;
-      }
-      out << spaces(2*level+1);
-      out << "</resources>" << endl;
+      case hw::memory:
+      case hw::address:
+      case hw::storage:
+      case hw::disk:
+      case hw::display:
+        out << "," << endl << spaces(2*level+2) << "\"units\" : \"bytes\"";
+        break;
+
+      case hw::processor:
+      case hw::bus:
+      case hw::system:
+        out << "," << endl << spaces(2*level+2) << "\"units\" : \"Hz\"";
+        break;
+
+      case hw::power:
+        out << "," << endl << spaces(2*level+2) << "\"units\" : \"mWh\"";
+        break;
+
+      case hw::network:
+        out << "," << endl << spaces(2*level+2) << "\"units\" : \"bit/s\"";
+        break;
+
+      default:
+        break;
     }
-    resources.clear();
+
+  if (n.getSize() > 0)
+  {
+    out << "," << endl;
+    out << spaces(2*level+2);
+    out << "\"size\" : ";
+    out << n.getSize();
+  }
+
+  if (n.getCapacity() > 0)
+  {
+    out << "," << endl;
+    out << spaces(2*level+2);
+    out << "\"capacity\" : ";
+    out << n.getCapacity();
   }
 
-  if(!::enabled("output:list") && countChildren()>0)
+  if (n.getWidth() > 0)
   {
     out << "," << endl;
     out << spaces(2*level+2);
-    out << "\"children\" : [";
-    for (unsigned int i = 0; i < countChildren(); i++)
+    out << "\"width\" : ";
+    out << n.getWidth();
+  }
+
+  if (n.getClock() > 0)
+  {
+    out << "," << endl;
+    out << spaces(2*level+2);
+    out << "\"clock\" : ";
+    out << n.getClock();
+  }
+
+  if (config.size() > 0)
+  {
+    out << "," << endl;
+    out << spaces(2*level+2);
+    out << "\"configuration\" : {" << endl;
+    for (unsigned int j = 0; j < config.size(); j++)
     {
-      out << getChild(i)->asJSON(visible(getClassName()) ? level + 2 : 1);
-      if (visible(getChild(i)->getClassName()) && i<countChildren()-1)
-      {
-        out << "," << endl;
-      }
+      if(j) out << "," << endl;
+      out << spaces(2*level+4);
+      out << "\"" << escapeJSON(config[j]) << "\" : \"" << escapeJSON(n.getConfig(config[j])) << "\"";
     }
-    out << "]";
+    out << endl << spaces(2*level+2);
+    out << "}";
   }
+  config.clear();
 
-  if(visible(getClassName()))
+  splitlines(n.getCapabilities(), config, ' ');
+  if (config.size() > 0)
   {
-    out << endl << spaces(2*level);
+    out << "," << endl;
+    out << spaces(2*level+2);
+    out << "\"capabilities\" : {" << endl;
+    for (unsigned int j = 0; j < config.size(); j++)
+    {
+      if(j) out << "," << endl;
+      out << spaces(2*level+4);
+      out << "\"" << escapeJSON(config[j]) << "\" : ";
+      if (n.getCapabilityDescription(config[j]) == "")
+      {
+        out << "true";
+      }
+      else
+      {
+        out << "\"";
+        out << escapeJSON(n.getCapabilityDescription(config[j]));
+        out << "\"";
+      }
+    }
+    out << endl << spaces(2*level+2);
     out << "}";
   }
+  config.clear();
 
-  if(::enabled("output:list") && countChildren()>0)
+  if (0 && resources.size() > 0)
   {
-    bool needcomma = visible(getClassName());
-    for (unsigned int i = 0; i < countChildren(); i++)
-      {
-        string json = getChild(i)->asJSON(visible(getClassName()) ? level + 2 : 1);
+    out << spaces(2*level+1);
+    out << "<resources>" << endl;
+    for (unsigned int j = 0; j < resources.size(); j++)
+    {
+      out << spaces(2*level+2);
+      out << "<resource type=\"" << escapeJSON(resources[j]) << "\" />";
+      out << endl;
+    }
+    out << spaces(2*level+1);
+    out << "</resources>" << endl;
+  }
+  resources.clear();
 
-        if(needcomma && strip(json)!="")
-          out << "," << endl;
-        out << getChild(i)->asJSON(visible(getClassName()) ? level + 2 : 1);
-        needcomma |= strip(json)!="";
-      }
+  if(list)
+    close(level);
+}
+
+void jsonwriter::beginchildren(hwNode &, unsigned level)
+{
+  if(list) return;
+
+  out << "," << endl;
+  out << spaces(2*level+2);
+  out << "\"children\" : [";
+}
+
+void jsonwriter::separator()
+{
+  if(!list)
+    out << "," << endl;
+}
+
+void jsonwriter::endchildren(hwNode &, unsigned)
+{
+  if(!list)
+    out << "]";
+}
+
+void jsonwriter::end(hwNode &, unsigned level)
+{
+  if(!list)
+    close(level);
+}
+
+void jsonwriter::close(unsigned level)
+{
+  out << endl << spaces(2*level);
+  out << "}";
+}
+
+static void writeJSON(hwNode & n, ostream & out, unsigned level)
+{
+  jsonwriter writer(out);
+
+  if (::enabled("output:list") && level == 0)
+  {
+    out << "[" << endl;
   }
 
+  walk(n, writer, level, 2);
+
   if (::enabled("output:list") && level == 0)
   {
     out << endl << "]" << endl;
   }
+}
+
+string hwNode::asJSON(unsigned level)
+{
+  ostringstream out;
+
+  if(!This) return "";
+
+  writeJSON(*this, out, level);
 
   return out.str();
 }
 
-string hwNode::asXML(unsigned level)
+void hwNode::asJSON(ostream & out)
+{
+  if(This)
+    writeJSON(*this, out, 0);
+}
+
+class xmlwriter: public treewriter
+{
+  public:
+    xmlwriter(ostream & o): out(o) {}
+
+    void begin(hwNode &, unsigned);
+    void end(hwNode &, unsigned);
+
+  private:
+    ostream & out;
+};
+
+void xmlwriter::begin(hwNode & n, unsigned level)
 {
   vector < string > config;
   vector < string > resources;
-  ostringstream out;
 
-  if(!This) return "";
+  config = n.getConfigKeys();
+  resources = n.getResources("\" value=\"");
 
-  config = getConfigKeys();
-  resources = getResources("\" value=\"");
+  out << spaces(2*level);
+  out << "<node id=\"" << n.getId() << "\"";
+  if (n.disabled())
+    out << " disabled=\"true\"";
+  if (n.claimed())
+    out << " claimed=\"true\"";
 
-  if (level == 0)
+  out << " class=\"" << n.getClassName() << "\"";
+  if(n.getHandle()!="") out << " handle=\"" << escape(n.getHandle()) << "\"";
+  if(n.getModalias()!="") out << " modalias=\"" << escape(n.getModalias()) << "\"";
+  out << ">" << endl;
+
+  if (n.getDescription() != "")
   {
-    struct utsname un;
+    out << spaces(2*level+1);
+    out << "<description>";
+    out << escape(n.getDescription());
+    out << "</description>";
+    out << endl;
+  }
 
-    out << "<?xml version=\"1.0\" standalone=\"yes\" ?>" << endl;
-    out << _("<!-- generated by lshw-") << getpackageversion() << " -->" <<
-  #if defined(__GNUC__) && defined(__VERSION__)
-      endl << "<!-- GCC " << escapecomment(__VERSION__) << " -->" <<
-  #endif
-      endl;
+  if (n.getProduct() != "")
+  {
+    out << spaces(2*level+1);
+    out << "<product>";
+    out << escape(n.getProduct());
+    out << "</product>";
+    out << endl;
+  }
 
-    if(uname(&un) == 0)
-      out << "<!-- " << escapecomment(un.sysname) << " " << escapecomment(un.release) << " " << escapecomment(un.version) << " " << escapecomment(un.machine) << " -->" << endl;
-  #if defined(__GLIBC__) && defined(_CS_GNU_LIBC_VERSION)
-    char version[PATH_MAX];
+  if (n.getVendor() != "")
+  {
+    out << spaces(2*level+1);
+    out << "<vendor>";
+    out << escape(n.getVendor());
+    out << "</vendor>";
+    out << endl;
+  }
 
-      if(confstr(_CS_GNU_LIBC_VERSION, version, sizeof(version))>0)
-        out << "<!-- GNU libc " << __GLIBC__ << " (" << escapecomment(version) << ") -->" << endl;
-  #endif
-    if (geteuid() != 0)
-      out << _("<!-- WARNING: not running as root -->") << endl;
+  if (n.getPhysId() != "")
+  {
+    out << spaces(2*level+1);
+    out << "<physid>";
+    out << n.getPhysId();
+    out << "</physid>";
+    out << endl;
+  }
 
-    if(::enabled("output:list"))
-      out << "<list>" << endl;
+  if (n.getSubProduct() != "")
+  {
+    out << spaces(2*level+1);
+    out << "<subproduct>";
+    out << escape(n.getSubProduct());
+    out << "</subproduct>";
+    out << endl;
+  }
 
+  if (n.getSubVendor() != "")
+  {
+    out << spaces(2*level+1);
+    out << "<subvendor>";
+    out << escape(n.getSubVendor());
+    out << "</subvendor>";
+    out << endl;
   }
 
-  if(visible(getClassName()))
+  if (n.getBusInfo() != "")
   {
-    out << spaces(2*level);
-    out << "<node id=\"" << getId() << "\"";
-    if (disabled())
-      out << " disabled=\"true\"";
-    if (claimed())
-      out << " claimed=\"true\"";
+    out << spaces(2*level+1);
+    out << "<businfo>";
+    out << escape(n.getBusInfo());
+    out << "</businfo>";
+    out << endl;
+  }
 
-    out << " class=\"" << getClassName() << "\"";
-    if(getHandle()!="") out << " handle=\"" << escape(getHandle()) << "\"";
-    if(getModalias()!="") out << " modalias=\"" << escape(getModalias()) << "\"";
-    out << ">" << endl;
+  if (n.getLogicalName() != "")
+  {
+    vector<string> logicalnames = n.getLogicalNames();
 
-    if (getDescription() != "")
+    for(unsigned int i = 0; i<logicalnames.size(); i++)
     {
       out << spaces(2*level+1);
-      out << "<description>";
-      out << escape(getDescription());
-      out << "</description>";
+      out << "<logicalname>";
+      out << logicalnames[i];
+      out << "</logicalname>";
       out << endl;
     }
+  }
 
-    if (getProduct() != "")
-    {
-      out << spaces(2*level+1);
-      out << "<product>";
-      out << escape(getProduct());
-      out << "</product>";
-      out << endl;
-    }
+  if (n.getDev() != "")
+  {
+    out << spaces(2*level+1);
+    out << "<dev>";
+    out << escape(n.getDev());
+    out << "</dev>";
+    out << endl;
+  }
 
-    if (getVendor() != "")
-    {
-      out << spaces(2*level+1);
-      out << "<vendor>";
-      out << escape(getVendor());
-      out << "</vendor>";
-      out << endl;
-    }
+  if (n.getVersion() != "")
+  {
+    out << spaces(2*level+1);
+    out << "<version>";
+    out << escape(n.getVersion());
+    out << "</version>";
+    out << endl;
+  }
 
-    if (getPhysId() != "")
-    {
-      out << spaces(2*level+1);
-      out << "<physid>";
-      out << getPhysId();
-      out << "</physid>";
-      out << endl;
-    }
+  if (n.getDate() != "")
+  {
+    out << spaces(2*level+1);
+    out << "<date>";
+    out << escape(n.getDate());
+    out << "</date>";
+    out << endl;
+  }
 
-    if (getSubProduct() != "")
-    {
-      out << spaces(2*level+1);
-      out << "<subproduct>";
-      out << escape(getSubProduct());
-      out << "</subproduct>";
-      out << endl;
-    }
+  if (n.getSerial() != "")
+  {
+    out << spaces(2*level+1);
+    out << "<serial>";
+    out << (::enabled("output:sanitize")?REMOVED:escape(n.getSerial()));
+    out << "</serial>";
+    out << endl;
+  }
 
-    if (getSubVendor() != "")
-    {
-      out << spaces(2*level+1);
-      out << "<subvendor>";
-      out << escape(getSubVendor());
-      out << "</subvendor>";
-      out << endl;
-    }
+  if (n.getSlot() != "")
+  {
+    out << spaces(2*level+1);
+    out << "<slot>";
+    out << escape(n.getSlot());
+    out << "</slot>";
+    out << endl;
+  }
 
-    if (getBusInfo() != "")
+  if (n.getSize() > 0)
+  {
+    out << spaces(2*level+1);
+    out << "<size";
+    switch (n.getClass())
     {
-      out << spaces(2*level+1);
-      out << "<businfo>";
-      out << escape(getBusInfo());
-      out << "</businfo>";
-      out << endl;
-    }
+      case hw::memory:
+      case hw::address:
+      case hw::storage:
+      case hw::disk:
+      case hw::volume:
+      case hw::display:
+        out << " units=\"bytes\"";
+        break;
+
+      case hw::processor:
+      case hw::bus:
+      case hw::system:
+        out << " units=\"Hz\"";
+        break;
 
-    if (getLogicalName() != "")
-    {
-      vector<string> logicalnames = getLogicalNames();
+      case hw::network:
+        out << " units=\"bit/s\"";
+        break;
 
-      for(unsigned int i = 0; i<logicalnames.size(); i++)
-      {
-        out << spaces(2*level+1);
-        out << "<logicalname>";
-        out << logicalnames[i];
-        out << "</logicalname>";
-        out << endl;
-      }
-    }
+      case hw::power:
+        out << " units=\"mWh\"";
+        break;
 
-    if (getDev() != "")
-    {
-      out << spaces(2*level+1);
-      out << "<dev>";
-      out << escape(getDev());
-      out << "</dev>";
-      out << endl;
+      default:
+        out << "";
     }
+    out << ">";
+    out << n.getSize();
+    out << "</size>";
+    out << endl;
+  }
 
-    if (getVersion() != "")
+  if (n.getCapacity() > 0)
+  {
+    out << spaces(2*level+1);
+    out << "<capacity";
+    switch (n.getClass())
     {
-      out << spaces(2*level+1);
-      out << "<version>";
-      out << escape(getVersion());
-      out << "</version>";
-      out << endl;
-    }
+      case hw::memory:
+      case hw::address:
+      case hw::storage:
+      case hw::disk:
+        out << " units=\"bytes\"";
+        break;
+
+      case hw::processor:
+      case hw::bus:
+      case hw::system:
+        out << " units=\"Hz\"";
+        break;
 
-    if (getDate() != "")
-    {
-      out << spaces(2*level+1);
-      out << "<date>";
-      out << escape(getDate());
-      out << "</date>";
-      out << endl;
-    }
+      case hw::power:
+        out << " units=\"mWh\"";
+        break;
 
-    if (getSerial() != "")
-    {
-      out << spaces(2*level+1);
-      out << "<serial>";
-      out << (::enabled("output:sanitize")?REMOVED:escape(getSerial()));
-      out << "</serial>";
-      out << endl;
+      default:
+        out << "";
     }
+    out << ">";
+    out << n.getCapacity();
+    out << "</capacity>";
+    out << endl;
+  }
+
+  if (n.getWidth() > 0)
+  {
+    out << spaces(2*level+1);
+    out << "<width units=\"bits\">";
+    out << n.getWidth();
+    out << "</width>";
+    out << endl;
+  }
+
+  if (n.getClock() > 0)
+  {
+    out << spaces(2*level+1);
+    out << "<clock units=\"Hz\">";
+    out << n.getClock();
+    out << "</clock>";
+    out << endl;
+  }
 
-    if (getSlot() != "")
+  if (config.size() > 0)
+  {
+    out << spaces(2*level+1);
+    out << "<configuration>" << endl;
+    for (unsigned int j = 0; j < config.size(); j++)
     {
-      out << spaces(2*level+1);
-      out << "<slot>";
-      out << escape(getSlot());
-      out << "</slot>";
+      out << spaces(2*level+2);
+      out << "<setting id=\"" << escape(config[j]) << "\" value=\"" << escape(n.getConfig(config[j])) << "\" />";
       out << endl;
     }
+    out << spaces(2*level+1);
+    out << "</configuration>" << endl;
+  }
+  config.clear();
 
-    if (getSize() > 0)
+  splitlines(n.getCapabilities(), config, ' ');
+  if (config.size() > 0)
+  {
+    out << spaces(2*level+1);
+    out << "<capabilities>" << endl;
+    for (unsigned int j = 0; j < config.size(); j++)
     {
-      out << spaces(2*level+1);
-      out << "<size";
-      switch (getClass())
+      out << spaces(2*level+2);
+      out << "<capability id=\"" << escape(config[j]);
+      if (n.getCapabilityDescription(config[j]) == "")
       {
-        case hw::memory:
-        case hw::address:
-        case hw::storage:
-        case hw::disk:
-        case hw::volume:
-        case hw::display:
-          out << " units=\"bytes\"";
-          break;
-
-        case hw::processor:
-        case hw::bus:
-        case hw::system:
-          out << " units=\"Hz\"";
-          break;
-
-        case hw::network:
-          out << " units=\"bit/s\"";
-          break;
-
-        case hw::power:
-          out << " units=\"mWh\"";
-          break;
-
-        default:
-          out << "";
+        out << "\" />";
       }
-      out << ">";
-      out << getSize();
-      out << "</size>";
-      out << endl;
-    }
-
-    if (getCapacity() > 0)
-    {
-      out << spaces(2*level+1);
-      out << "<capacity";
-      switch (getClass())
+      else
       {
-        case hw::memory:
-        case hw::address:
-        case hw::storage:
-        case hw::disk:
-          out << " units=\"bytes\"";
-          break;
-
-        case hw::processor:
-        case hw::bus:
-        case hw::system:
-          out << " units=\"Hz\"";
-          break;
-
-        case hw::power:
-          out << " units=\"mWh\"";
-          break;
-
-        default:
-          out << "";
+        out << "\" >";
+        out << escape(n.getCapabilityDescription(config[j]));
+        out << "</capability>";
       }
-      out << ">";
-      out << getCapacity();
-      out << "</capacity>";
       out << endl;
     }
+    out << spaces(2*level+1);
+    out << "</capabilities>" << endl;
+  }
+  config.clear();
 
-    if (getWidth() > 0)
+  if (resources.size() > 0)
+  {
+    out << spaces(2*level+1);
+    out << "<resources>" << endl;
+    for (unsigned int j = 0; j < resources.size(); j++)
     {
-      out << spaces(2*level+1);
-      out << "<width units=\"bits\">";
-      out << getWidth();
-      out << "</width>";
+      out << spaces(2*level+2);
+      out << "<resource type=\"" << resources[j] << "\" />";
       out << endl;
     }
+    out << spaces(2*level+1);
+    out << "</resources>" << endl;
+  }
+  resources.clear();
 
-    if (getClock() > 0)
-    {
-      out << spaces(2*level+1);
-      out << "<clock units=\"Hz\">";
-      out << getClock();
-      out << "</clock>";
+  vector < string > hints = n.getHints();
+  if (hints.size() > 0) {
+    out << spaces(2*level+1);
+    out << "<hints>" << endl;
+    for(unsigned int i=0; i<hints.size(); i++) {
+      out << spaces(2*level+2);
+      out << "<hint name=\"" << hints[i] << "\" " << "value=\"" << n.getHint(hints[i]).asString() << "\" />";
       out << endl;
     }
+    out << spaces(2*level+1);
+    out << "</hints>" << endl;
+  }
+}
+
+void xmlwriter::end(hwNode &, unsigned level)
+{
+  out << spaces(2*level);
+  out << "</node>" << endl;
+}
+
+static void writeXML(hwNode & n, ostream & out, unsigned level)
+{
+  xmlwriter writer(out);
+
+  if (level == 0)
+  {
+    struct utsname un;
+
+    out << "<?xml version=\"1.0\" standalone=\"yes\" ?>" << endl;
+    out << _("<!-- generated by lshw-") << getpackageversion() << " -->" <<
+  #if defined(__GNUC__) && defined(__VERSION__)
+      endl << "<!-- GCC " << escapecomment(__VERSION__) << " -->" <<
+  #endif
+      endl;
+
+    if(uname(&un) == 0)
+      out << "<!-- " << escapecomment(un.sysname) << " " << escapecomment(un.release) << " " << escapecomment(un.version) << " " << escapecomment(un.machine) << " -->" << endl;
+  #if defined(__GLIBC__) && defined(_CS_GNU_LIBC_VERSION)
+    char version[PATH_MAX];
+
+      if(confstr(_CS_GNU_LIBC_VERSION, version, sizeof(version))>0)
+        out << "<!-- GNU libc " << __GLIBC__ << " (" << escapecomment(version) << ") -->" << endl;
+  #endif
+    if (geteuid() != 0)
+      out << _("<!-- WARNING: not running as root -->") << endl;
+
+    if(::enabled("output:list"))
+      out << "<list>" << endl;
+
+  }
+
+  walk(n, writer, level, 1);
+
+  if((level==0) && ::enabled("output:list"))
+    out << "</list>" << endl;
+}
+
+string hwNode::asXML(unsigned level)
+{
+  ostringstream out;
+
+  if(!This) return "";
 
-    if (config.size() > 0)
+  writeXML(*this, out, level);
+
+  return out.str();
+}
+
+void hwNode::asXML(ostream & out)
+{
+  if(This)
+    writeXML(*this, out, 0);
+}
+
+/*
+ * CBOR (RFC 8949) output: every node is a map with the same keys as in the
+ * JSON output; maps and arrays are written with indefinite lengths so that
+ * nothing has to be counted or buffered in advance
+ *
+ * the whole document is a stringref namespace (tag 256, see
+ * http://cbor.schmorp.de/stringref): keys and values that have already been
+ * written are replaced by a reference to their first occurrence (tag 25)
+ */
+class cborwriter: public treewriter
+{
+  public:
+    cborwriter(ostream & o): out(o), list(::enabled("output:list")) {}
+
+    void begin(hwNode &, unsigned);
+    void beginchildren(hwNode &, unsigned);
+    void endchildren(hwNode &, unsigned);
+    void end(hwNode &, unsigned);
+
+    void head(unsigned char major, unsigned long long n);
+    void text(const string &);
+    void field(const char *, const string &);
+    void field(const char *, unsigned long long);
+    void flag(const char *, bool);
+    void open(char c) { out.put(c); }
+    void close() { out.put((char)0xff); }
+
+  private:
+    ostream & out;
+    bool list;
+    map < string, unsigned long long > strings;   // stringref table
+};
+
+#define CBOR_MAP '\xbf'
+#define CBOR_ARRAY '\x9f'
+#define CBOR_TRUE '\xf5'
+#define CBOR_SELFDESCRIBE 55799
+#define CBOR_STRINGREF 25
+#define CBOR_STRINGREF_NAMESPACE 256
+
+void cborwriter::head(unsigned char major, unsigned long long n)
+{
+  unsigned int bytes = 0;
+
+  major <<= 5;
+  if (n < 24)
+  {
+    out.put((char)(major | n));
+    return;
+  }
+
+  if (n <= 0xff) { major |= 24; bytes = 1; }
+  else if (n <= 0xffff) { major |= 25; bytes = 2; }
+  else if (n <= 0xffffffffULL) { major |= 26; bytes = 4; }
+  else { major |= 27; bytes = 8; }
+
+  out.put((char)major);
+  while (bytes--)
+    out.put((char)((n >> (8*bytes)) & 0xff));
+}
+
+void cborwriter::text(const string & s)
+{
+  map < string, unsigned long long >::const_iterator ref = strings.find(s);
+  unsigned long long n = strings.size();
+  size_t minlength = 11;
+
+  if (ref != strings.end())
+  {
+    head(6, CBOR_STRINGREF);
+    head(0, ref->second);
+    return;
+  }
+
+// only strings longer than a reference to them get a number
+  if (n < 24) minlength = 3;
+  else if (n < 0x100) minlength = 4;
+  else if (n < 0x10000) minlength = 5;
+  else if (n < 0x100000000ULL) minlength = 7;
+  if (s.length() >= minlength)
+    strings[s] = n;
+
+  head(3, s.length());
+  out.write(s.data(), s.length());
+}
+
+void cborwriter::field(const char *key, const string & value)
+{
+  if (value == "") return;
+
+  text(key);
+  text(value);
+}
+
+void cborwriter::field(const char *key, unsigned long long value)
+{
+  if (value == 0) return;
+
+  text(key);
+  head(0, value);
+}
+
+void cborwriter::flag(const char *key, bool value)
+{
+  if (!value) return;
+
+  text(key);
+  out.put(CBOR_TRUE);
+}
+
+void cborwriter::begin(hwNode & n, unsigned)
+{
+  vector < string > keys;
+
+  open(CBOR_MAP);
+  field("id", n.getId());
+  field("class", n.getClassName());
+  flag("disabled", n.disabled());
+  flag("claimed", n.claimed());
+  field("handle", n.getHandle());
+  field("modalias", n.getModalias());
+  field("description", n.getDescription());
+  field("product", n.getProduct());
+  field("vendor", n.getVendor());
+  field("physid", n.getPhysId());
+  field("subproduct", n.getSubProduct());
+  field("subvendor", n.getSubVendor());
+  field("businfo", n.getBusInfo());
+
+// a single logical name is a string, several are an array (as in JSON)
+  keys = n.getLogicalNames();
+  if (keys.size() == 1)
+    field("logicalname", keys[0]);
+  else if (keys.size() > 1)
+  {
+    text("logicalname");
+    head(4, keys.size());
+    for (unsigned int i = 0; i < keys.size(); i++)
+      text(keys[i]);
+  }
+
+  field("dev", n.getDev());
+  field("version", n.getVersion());
+  field("date", n.getDate());
+  if (n.getSerial() != "")
+    field("serial", ::enabled("output:sanitize")?REMOVED:n.getSerial());
+  field("slot", n.getSlot());
+
+  if ((n.getSize() > 0) || (n.getCapacity() > 0))
+    switch (n.getClass())
     {
-      out << spaces(2*level+1);
-      out << "<configuration>" << endl;
-      for (unsigned int j = 0; j < config.size(); j++)
-      {
-        out << spaces(2*level+2);
-        out << "<setting id=\"" << escape(config[j]) << "\" value=\"" << escape(getConfig(config[j])) << "\" />";
-        out << endl;
-      }
-      out << spaces(2*level+1);
-      out << "</configuration>" << endl;
+      case hw::memory:
+      case hw::address:
+      case hw::storage:
+      case hw::disk:
+      case hw::display:
+        field("units", "bytes");
+        break;
+
+      case hw::processor:
+      case hw::bus:
+      case hw::system:
+        field("units", "Hz");
+        break;
+
+      case hw::power:
+        field("units", "mWh");
+        break;
+
+      case hw::network:
+        field("units", "bit/s");
+        break;
+
+      default:
+        break;
     }
-    config.clear();
 
-    splitlines(getCapabilities(), config, ' ');
-    if (config.size() > 0)
+  field("size", n.getSize());
+  field("capacity", n.getCapacity());
+  field("width", n.getWidth());
+  field("clock", n.getClock());
+
+  keys = n.getConfigKeys();
+  if (keys.size() > 0)
+  {
+    text("configuration");
+    head(5, keys.size());
+    for (unsigned int i = 0; i < keys.size(); i++)
     {
-      out << spaces(2*level+1);
-      out << "<capabilities>" << endl;
-      for (unsigned int j = 0; j < config.size(); j++)
-      {
-        out << spaces(2*level+2);
-        out << "<capability id=\"" << escape(config[j]);
-        if (getCapabilityDescription(config[j]) == "")
-        {
-          out << "\" />";
-        }
-        else
-        {
-          out << "\" >";
-          out << escape(getCapabilityDescription(config[j]));
-          out << "</capability>";
-        }
-        out << endl;
-      }
-      out << spaces(2*level+1);
-      out << "</capabilities>" << endl;
+      text(keys[i]);
+      text(n.getConfig(keys[i]));
     }
-    config.clear();
+  }
+  keys.clear();
 
-    if (resources.size() > 0)
+  splitlines(n.getCapabilities(), keys, ' ');
+  if (keys.size() > 0)
+  {
+    text("capabilities");
+    head(5, keys.size());
+    for (unsigned int i = 0; i < keys.size(); i++)
     {
-      out << spaces(2*level+1);
-      out << "<resources>" << endl;
-      for (unsigned int j = 0; j < resources.size(); j++)
-      {
-        out << spaces(2*level+2);
-        out << "<resource type=\"" << resources[j] << "\" />";
-        out << endl;
-      }
-      out << spaces(2*level+1);
-      out << "</resources>" << endl;
-    }
-    resources.clear();
+      string description = n.getCapabilityDescription(keys[i]);
 
-    vector < string > hints = getHints();
-    if (hints.size() > 0) {
-      out << spaces(2*level+1);
-      out << "<hints>" << endl;
-      for(unsigned int i=0; i<hints.size(); i++) {
-        out << spaces(2*level+2);
-        out << "<hint name=\"" << hints[i] << "\" " << "value=\"" << getHint(hints[i]).asString() << "\" />";
-        out << endl;
-      }
-      out << spaces(2*level+1);
-      out << "</hints>" << endl;
+      text(keys[i]);
+      if (description == "")
+        out.put(CBOR_TRUE);
+      else
+        text(description);
     }
   }
+  keys.clear();
 
-  for (unsigned int i = 0; i < countChildren(); i++)
+// resources are [ type, value ] pairs: a node can have several of each type
+  keys = n.getResources(":");
+  if (keys.size() > 0)
   {
-    out << getChild(i)->asXML(visible(getClassName()) ? level + 1 : 1);
+    text("resources");
+    head(4, keys.size());
+    for (unsigned int i = 0; i < keys.size(); i++)
+    {
+      size_t colon = keys[i].find_first_of(':');
+
+      head(4, 2);
+      text(keys[i].substr(0, colon));
+      text(colon == string::npos ? "" : keys[i].substr(colon + 1));
+    }
   }
 
-  if(visible(getClassName()))
+  keys = n.getHints();
+  if (keys.size() > 0)
   {
-    out << spaces(2*level);
-    out << "</node>" << endl;
+    text("hints");
+    head(5, keys.size());
+    for (unsigned int i = 0; i < keys.size(); i++)
+    {
+      text(keys[i]);
+      text(n.getHint(keys[i]).asString());
+    }
   }
 
-  if((level==0) && ::enabled("output:list"))
-    out << "</list>" << endl;
+  if (list)
+    close();
+}
+
+void cborwriter::beginchildren(hwNode &, unsigned)
+{
+  if (list) return;
 
+  text("children");
+  open(CBOR_ARRAY);
+}
 
-  return out.str();
+void cborwriter::endchildren(hwNode &, unsigned)
+{
+  if (!list)
+    close();
+}
+
+void cborwriter::end(hwNode &, unsigned)
+{
+  if (!list)
+    close();
+}
+
+void hwNode::asCBOR(ostream & out)
+{
+  if(!This) return;
+
+  cborwriter writer(out);
+
+  writer.head(6, CBOR_SELFDESCRIBE);
+  writer.head(6, CBOR_STRINGREF_NAMESPACE);
+  if (::enabled("output:list"))
+    writer.open(CBOR_ARRAY);
+
+  walk(*this, writer, 0, 1);
+
+  if (::enabled("output:list"))
+    writer.close();
 }
 
 string hwNode::asString()
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <iosfwd>
 
 using namespace std;
 
@@ -100,6 +101,7 @@ class hwNode
       const string & product = "",
       const string & version = "");
     hwNode(const hwNode & o);
+    hwNode(hwNode && o) noexcept;
     ~hwNode();
     hwNode & operator =(const hwNode & o);
 
@@ -176,6 +178,7 @@ class hwNode
     hwNode * findChildByResource(const hw::resource &);
     hwNode * findChild(bool(*matchfunction)(const hwNode &));
     hwNode * addChild(const hwNode & node);
+    hwNode * addChild(hwNode && node);
     bool isBus() const
     {
       return countChildren()>0;
@@ -226,7 +229,10 @@ class hwNode
     void fixInconsistencies();
 
     string asXML(unsigned level = 0);
+    void asXML(ostream & out);
     string asJSON(unsigned level = 0);
+    void asJSON(ostream & out);
+    void asCBOR(ostream & out);
     string asString();
 
     bool dump(const string & filename, bool recurse = true);
@@ -237,6 +243,10 @@ class hwNode
     bool attractsHandle(const string & handle) const;
     bool attractsNode(const hwNode & node) const;
 
+    void attach(struct hwNode_i * parent);
+
+    friend struct hwNode_index;
+
     struct hwNode_i * This;
 };
 #endif
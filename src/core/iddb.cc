@@ -0,0 +1,384 @@
+/*
+ * iddb.cc
+ *
+ * Precompiled ID database: a header, the list of text files it was built
+ * from, one table of fixed-size entries per kind of ID (sorted by IDs, then
+ * by position in the text files) and a table of interned, NUL-terminated
+ * strings. Numbers are in host byte order and all references are offsets in
+ * the file, so it can be used straight from mmap() and its pages are shared
+ * by all the processes using it.
+ */
+
+#include "version.h"
+#include "config.h"
+#include "iddb.h"
+#include "osutils.h"
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+
+__ID("@(#) $Id$");
+
+using namespace std;
+
+#define IDDB_PATH DATADIR "/ids.db:" DATADIR "/lshw/ids.db:/usr/share/lshw/ids.db"
+#define IDDB_MAGIC "LSHWIDDB"
+#define IDDB_VERSION 1
+
+struct iddb_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t sources, sourcecount;
+  uint32_t strings, stringsize;
+  uint32_t reserved;
+  struct
+  {
+    uint32_t offset, count;
+  } tables[iddb_tables];
+};
+
+struct iddb_source
+{
+  uint32_t group;
+  uint32_t reserved;
+  int64_t size;
+  int64_t mtime;
+};
+
+struct iddb_entry
+{
+  int32_t ids[4];
+  uint32_t order;                                 // position in the text files
+  uint32_t text;                                  // string offset
+};
+
+static struct
+{
+  const char *base;
+  size_t size;
+  const iddb_header *header;
+} db;
+static once_flag db_once;
+
+// checks that a table lies entirely inside the file
+static bool inside(size_t size, uint32_t offset, uint32_t count, size_t record)
+{
+  return (offset <= size) && ((size - offset) / record >= count);
+}
+
+static bool open_iddb(const string & filename)
+{
+  struct stat buf;
+  const iddb_header *h;
+  bool valid = true;
+
+  int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  if ((fstat(fd, &buf) != 0) || ((size_t)buf.st_size < sizeof(iddb_header)))
+  {
+    close(fd);
+    return false;
+  }
+
+  void *base = mmap(NULL, buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return false;
+
+  h = (const iddb_header *)base;
+  valid = (memcmp(h->magic, IDDB_MAGIC, sizeof(h->magic)) == 0) &&
+    (h->version == IDDB_VERSION) &&
+    inside(buf.st_size, h->sources, h->sourcecount, sizeof(iddb_source)) &&
+    inside(buf.st_size, h->strings, h->stringsize, 1) &&
+    (h->stringsize > 0) &&
+    (((const char *)base)[h->strings + h->stringsize - 1] == '\0');
+  for (unsigned int t = 0; valid && (t < iddb_tables); t++)
+    valid = inside(buf.st_size, h->tables[t].offset, h->tables[t].count, sizeof(iddb_entry)) &&
+      (h->tables[t].offset % sizeof(int32_t) == 0);
+
+  if (!valid)
+  {
+    munmap(base, buf.st_size);
+    return false;
+  }
+
+  db.base = (const char *)base;
+  db.size = buf.st_size;
+  db.header = h;
+  return true;
+}
+
+static void load_iddb()
+{
+  vector < string > filenames;
+
+  splitlines(IDDB_PATH, filenames, ':');
+  for (unsigned int i = 0; i < filenames.size(); i++)
+    if (open_iddb(filenames[i]))
+      return;
+}
+
+// the file loadfile() would actually read
+static bool stat_source(const string & file, bool compressed, struct stat & buf)
+{
+#ifdef ZLIB
+  if (compressed && (stat((file + ".gz").c_str(), &buf) == 0))
+    return true;
+#endif
+  return stat(file.c_str(), &buf) == 0;
+}
+
+bool iddb_usable(iddb_group g, const vector < string > & files, bool compressed)
+{
+  const iddb_source *sources = NULL;
+  unsigned int s = 0;
+
+  call_once(db_once, load_iddb);
+  if (!db.header)
+    return false;
+
+  sources = (const iddb_source *)(db.base + db.header->sources);
+  for (unsigned int i = 0; i < files.size(); i++)
+  {
+    struct stat buf;
+
+    if (!stat_source(files[i], compressed, buf))
+      continue;
+
+    while ((s < db.header->sourcecount) && (sources[s].group != (uint32_t)g))
+      s++;
+    if ((s >= db.header->sourcecount) ||
+      (sources[s].size != (int64_t)buf.st_size) ||
+      (sources[s].mtime != (int64_t)buf.st_mtime))
+      return false;
+    s++;
+  }
+
+  for (; s < db.header->sourcecount; s++)          // was built from more files
+    if (sources[s].group == (uint32_t)g)
+      return false;
+
+  return true;
+}
+
+// compares the first n IDs of a and b
+static int compare_ids(const int32_t *a, const int32_t *b, unsigned int n)
+{
+  for (unsigned int i = 0; i < n; i++)
+  {
+    if (a[i] < b[i])
+      return -1;
+    if (a[i] > b[i])
+      return 1;
+  }
+
+  return 0;
+}
+
+bool iddb_find(iddb_table t, string & result,
+long u1, long u2, long u3, long u4,
+bool partial)
+{
+  int32_t ids[4] = { (int32_t)u1, (int32_t)u2, (int32_t)u3, (int32_t)u4 };
+  const iddb_entry *entries = NULL;
+  uint32_t count = 0;
+
+  call_once(db_once, load_iddb);
+  if (!db.header || ((unsigned int)t >= iddb_tables))
+    return false;
+
+  entries = (const iddb_entry *)(db.base + db.header->tables[t].offset);
+  count = db.header->tables[t].count;
+
+  for (unsigned int n = 4; n >= (partial ? 1 : 4); n--)
+  {
+    uint32_t lo = 0, hi = count;
+    const iddb_entry *best = NULL;
+
+    while (lo < hi)                               // first entry >= ids
+    {
+      uint32_t mid = lo + (hi - lo) / 2;
+
+      if (compare_ids(entries[mid].ids, ids, n) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+    for (; (lo < count) && (compare_ids(entries[lo].ids, ids, n) == 0); lo++)
+      if (!best || (entries[lo].order < best->order))
+        best = entries + lo;
+
+    if (best)
+    {
+      if (best->text >= db.header->stringsize)
+        return false;
+      result = string(db.base + db.header->strings + best->text);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+long iddb_key(const string & s)
+{
+  uint32_t result = 0;
+
+  if (s.length() > sizeof(result))
+    return -1;                                    // too long, can't match
+
+  for (unsigned int i = 0; i < s.length(); i++)
+    result = (result << 8) | (unsigned char)s[i];
+
+  return (int32_t)result;
+}
+
+struct iddb_writer_i
+{
+  vector < iddb_source > sources;
+  vector < iddb_entry > tables[iddb_tables];
+  string strings;
+  map < string, uint32_t > interned;
+};
+
+iddb_writer::iddb_writer()
+{
+  This = new iddb_writer_i;
+  This->strings = string(1, '\0');
+}
+
+iddb_writer::~iddb_writer()
+{
+  delete This;
+}
+
+void iddb_writer::source(iddb_group g, const string & file, bool compressed)
+{
+  struct stat buf;
+  iddb_source s;
+
+  if (!This || !stat_source(file, compressed, buf))
+    return;
+
+  memset(&s, 0, sizeof(s));
+  s.group = g;
+  s.size = buf.st_size;
+  s.mtime = buf.st_mtime;
+  This->sources.push_back(s);
+}
+
+void iddb_writer::add(iddb_table t, const string & text,
+long u1, long u2, long u3, long u4)
+{
+  iddb_entry e;
+
+  if (!This || ((unsigned int)t >= iddb_tables))
+    return;
+
+  e.ids[0] = u1;
+  e.ids[1] = u2;
+  e.ids[2] = u3;
+  e.ids[3] = u4;
+  e.order = This->tables[t].size();
+
+  map < string, uint32_t >::iterator i = This->interned.find(text);
+  if (i != This->interned.end())
+    e.text = i->second;
+  else
+  {
+    e.text = This->strings.length();
+    This->strings += text;
+    This->strings += '\0';
+    This->interned[text] = e.text;
+  }
+
+  This->tables[t].push_back(e);
+}
+
+static bool entry_order(const iddb_entry & a, const iddb_entry & b)
+{
+  int c = compare_ids(a.ids, b.ids, 4);
+
+  if (c != 0)
+    return c < 0;
+  return a.order < b.order;
+}
+
+static bool writeall(int fd, const void *data, size_t len)
+{
+  const char *p = (const char *)data;
+
+  while (len > 0)
+  {
+    ssize_t n = write(fd, p, len);
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool iddb_writer::write(const string & filename)
+{
+  iddb_header header;
+  uint32_t offset = sizeof(header);
+  bool ok = true;
+
+  if (!This)
+    return false;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, IDDB_MAGIC, sizeof(header.magic));
+  header.version = IDDB_VERSION;
+
+  offset = (offset + 7) & ~7;
+  header.sources = offset;
+  header.sourcecount = This->sources.size();
+  offset += This->sources.size() * sizeof(iddb_source);
+  for (unsigned int t = 0; t < iddb_tables; t++)
+  {
+    sort(This->tables[t].begin(), This->tables[t].end(), entry_order);
+    header.tables[t].offset = offset;
+    header.tables[t].count = This->tables[t].size();
+    offset += This->tables[t].size() * sizeof(iddb_entry);
+  }
+  header.strings = offset;
+  header.stringsize = This->strings.length();
+
+  string tmp = filename + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return false;
+
+  ok = writeall(fd, &header, sizeof(header));
+  if (ok && (header.sources > sizeof(header)))
+    ok = writeall(fd, "\0\0\0\0\0\0\0", header.sources - sizeof(header));
+  if (ok && This->sources.size())
+    ok = writeall(fd, &This->sources[0], This->sources.size() * sizeof(iddb_source));
+  for (unsigned int t = 0; ok && (t < iddb_tables); t++)
+    if (This->tables[t].size())
+      ok = writeall(fd, &This->tables[t][0], This->tables[t].size() * sizeof(iddb_entry));
+  if (ok)
+    ok = writeall(fd, This->strings.data(), This->strings.length());
+
+  if ((close(fd) != 0) || !ok || (rename(tmp.c_str(), filename.c_str()) != 0))
+  {
+    unlink(tmp.c_str());
+    return false;
+  }
+
+  return true;
+}
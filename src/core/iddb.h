@@ -0,0 +1,68 @@
+#ifndef _IDDB_H_
+#define _IDDB_H_
+
+#include <string>
+#include <vector>
+
+/*
+ * precompiled ID database: pci.ids, usb.ids, pnp.ids and pnpid.txt turned
+ * into sorted tables that are used straight from mmap() (see compile-ids)
+ *
+ * every entry is keyed by up to 4 32-bit IDs (unused ones are -1); short
+ * strings such as PnP vendor codes are packed into IDs with iddb_key()
+ */
+typedef enum
+{
+  iddb_pcidevices,
+  iddb_pciclasses,
+  iddb_usbvendors,
+  iddb_usbproducts,
+  iddb_pnpvendors,
+  iddb_pnpids,
+  iddb_tables
+} iddb_table;
+
+// the text files a group of tables was compiled from
+typedef enum
+{
+  iddb_pci,
+  iddb_usb,
+  iddb_pnp
+} iddb_group;
+
+/*
+ * true when the compiled database exists and was built from exactly the text
+ * files (given in the order they would be loaded) that are found on this
+ * system; when one of them changed, the text files have to be used instead
+ */
+bool iddb_usable(iddb_group g, const std::vector < std::string > & files, bool compressed);
+
+/*
+ * exact lookup, or (when partial is set) the entry sharing the longest prefix
+ * of IDs, the first one in file order if several do
+ */
+bool iddb_find(iddb_table t, std::string & result,
+  long u1, long u2 = -1, long u3 = -1, long u4 = -1,
+  bool partial = false);
+
+// packs a string of up to 4 characters into an ID
+long iddb_key(const std::string & s);
+
+class iddb_writer
+{
+  public:
+    iddb_writer();
+    ~iddb_writer();
+
+    void source(iddb_group g, const std::string & file, bool compressed);
+    void add(iddb_table t, const std::string & text,
+      long u1, long u2 = -1, long u3 = -1, long u4 = -1);
+    bool write(const std::string & filename);
+
+  private:
+    iddb_writer(const iddb_writer &);
+    iddb_writer & operator =(const iddb_writer &);
+
+    struct iddb_writer_i *This;
+};
+#endif
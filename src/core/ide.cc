@@ -96,7 +96,7 @@ static const char *description[] =
 
 static unsigned long long get_longlong(const string & path)
 {
-  FILE *in = fopen(path.c_str(), "r");
+  FILE *in = fopen_file(path);
   unsigned long long l = 0;
 
   if (in)
@@ -130,7 +130,7 @@ hwNode & device)
 {
   struct hd_driveid id;
   const u_int8_t *id_regs = (const u_int8_t *) &id;
-  int fd = open(device.getLogicalName().c_str(), O_RDONLY | O_NONBLOCK);
+  int fd = open_file(device.getLogicalName(), O_RDONLY | O_NONBLOCK);
 
   if (fd < 0)
     return false;
@@ -358,7 +358,7 @@ bool scan_ide(hwNode & n)
   int nentries;
 
   pushd(PROC_IDE);
-  nentries = scandir(".", &namelist, selectdir, alphasort);
+  nentries = scan_dir(".", &namelist, selectdir);
   popd();
 
   if (nentries < 0)
@@ -402,7 +402,7 @@ bool scan_ide(hwNode & n)
         int ndevices;
 
         pushd(string(PROC_IDE) + "/" + namelist[i]->d_name);
-        ndevices = scandir(".", &devicelist, selectdir, alphasort);
+        ndevices = scan_dir(".", &devicelist, selectdir);
         popd();
 
         for (int j = 0; j < ndevices; j++)
@@ -431,7 +431,7 @@ bool scan_ide(hwNode & n)
 
           probe_ide(devicelist[j]->d_name, idedevice);
 
-          ide.addChild(idedevice);
+          ide.addChild(std::move(idedevice));
           free(devicelist[j]);
         }
         free(devicelist);
@@ -447,7 +447,7 @@ bool scan_ide(hwNode & n)
           {
             parent->claim();
             ide.setClock(parent->getClock());
-            parent->addChild(ide);
+            parent->addChild(std::move(ide));
           }
         }
         else                                      // we have to guess the parent device
@@ -457,7 +457,7 @@ bool scan_ide(hwNode & n)
           {
             parent->claim();
             ide.setClock(parent->getClock());
-            parent->addChild(ide);
+            parent->addChild(std::move(ide));
           }
           else
             for (unsigned int k = 0; k < ide.countChildren(); k++)
@@ -472,7 +472,7 @@ bool scan_ide(hwNode & n)
               break;
             }
           }
-          if(!parent) n.addChild(ide);
+          if(!parent) n.addChild(std::move(ide));
         }
       }
 
@@ -234,7 +234,7 @@ static bool probe_port(unsigned controller, unsigned disknum, hwNode & parent)
   struct hd_driveid id;
   const u_int8_t *id_regs = (const u_int8_t *) &id;
   string devname = string(DEV_TWE) + tostring(controller);
-  int fd = open(devname.c_str(), O_RDONLY | O_NONBLOCK);
+  int fd = open_file(devname, O_RDONLY | O_NONBLOCK);
   unsigned char ioctl_buffer[2*TW_IOCTL_BUFFER_SIZE];
 
    // only used for 6000/7000/8000 char device interface
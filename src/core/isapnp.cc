@@ -11,6 +11,7 @@
 #include "version.h"
 #include "isapnp.h"
 #include "pnp.h"
+#include "context.h"
 
 __ID("@(#) $Id$");
 
@@ -91,9 +92,21 @@ struct isapnp_device_id
   unsigned long driver_data;                      /* data private to the driver */
 };
 
-static int isapnp_rdp;                            /* Read Data Port */
-static int isapnp_reset = 0;                      /* reset all PnP cards (deactivate) */
-static bool isapnp_error = false;
+struct isapnp_state
+{
+  isapnp_state(): rdp(0), reset(0), error(false), checksum_value(0), detected(0) {}
+
+  int rdp;                                        /* Read Data Port */
+  int reset;                                      /* reset all PnP cards (deactivate) */
+  bool error;
+  unsigned char checksum_value;
+  int detected;
+};
+
+static isapnp_state & state()
+{
+  return context().state<isapnp_state>();
+}
 
 #define _PIDXR    0x279
 #define _PNPWRP   0xa79
@@ -118,9 +131,6 @@ static bool isapnp_error = false;
 #define _LTAG_MEM32RANGE  0x85
 #define _LTAG_FIXEDMEM32RANGE 0x86
 
-static unsigned char isapnp_checksum_value;
-static int isapnp_detected;
-
 /* some prototypes */
 
 static void udelay(unsigned long l)
@@ -150,7 +160,7 @@ static bool write_data(unsigned char x)
   }
   else
   {
-    isapnp_error = true;
+    state().error = true;
     return false;
   }
 }
@@ -172,7 +182,7 @@ static bool write_address(unsigned char x)
   }
   else
   {
-    isapnp_error = true;
+    state().error = true;
     return false;
   }
 }
@@ -185,14 +195,14 @@ static unsigned char read_data(void)
 
   if (fd >= 0)
   {
-    lseek(fd, isapnp_rdp, SEEK_SET);
+    lseek(fd, state().rdp, SEEK_SET);
     if(read(fd, &val, 1) != 1)
       val = 0;
     close(fd);
   }
   else
   {
-    isapnp_error = true;
+    state().error = true;
   }
   return val;
 }
@@ -259,14 +269,14 @@ int bytes)
   int i, j;
   unsigned char d = 0;
 
-  isapnp_error = false;
+  state().error = false;
 
   for (i = 1; i <= bytes; i++)
   {
     for (j = 0; j < 20; j++)
     {
       d = isapnp_read_byte(0x05);
-      if (isapnp_error)
+      if (state().error)
         return false;
       if (d & 1)
         break;
@@ -279,7 +289,7 @@ int bytes)
       continue;
     }
     d = isapnp_read_byte(0x04);                   /* PRESDI */
-    isapnp_checksum_value += d;
+    state().checksum_value += d;
     if (data != NULL)
       *data++ = d;
   }
@@ -291,7 +301,7 @@ int bytes)
 
 static int isapnp_next_rdp(void)
 {
-  int rdp = isapnp_rdp;
+  int rdp = state().rdp;
   while (rdp <= 0x3ff)
   {
 /*
@@ -300,7 +310,7 @@ static int isapnp_next_rdp(void)
  */
     if ((rdp < 0x280 || rdp > 0x380) /*&& !check_region(rdp, 1) */ )
     {
-      isapnp_rdp = rdp;
+      state().rdp = rdp;
       return 0;
     }
     rdp += RDP_STEP;
@@ -312,7 +322,7 @@ static int isapnp_next_rdp(void)
 /* Set read port address */
 static inline bool isapnp_set_rdp(void)
 {
-  if (isapnp_write_byte(0x00, isapnp_rdp >> 2))
+  if (isapnp_write_byte(0x00, state().rdp >> 2))
   {
     udelay(100);
     return true;
@@ -337,7 +347,7 @@ static int isapnp_isolate_rdp_select(void)
 /*
  * Control: reset CSN and conditionally everything else too
  */
-  if (!isapnp_write_byte(0x02, isapnp_reset ? 0x05 : 0x04))
+  if (!isapnp_write_byte(0x02, state().reset ? 0x05 : 0x04))
     return -1;
   udelay(2);
 
@@ -377,17 +387,17 @@ static int isapnp_isolate(void)
   int i;
   int iteration = 1;
 
-  isapnp_rdp = 0x213;
+  state().rdp = 0x213;
   if (isapnp_isolate_rdp_select() < 0)
     return -1;
 
-  isapnp_error = false;
+  state().error = false;
 
   while (1)
   {
     for (i = 1; i <= 64; i++)
     {
-      if (isapnp_error)
+      if (state().error)
         return -1;
 
       data = read_data() << 8;
@@ -403,7 +413,7 @@ static int isapnp_isolate(void)
     }
     for (i = 65; i <= 72; i++)
     {
-      if (isapnp_error)
+      if (state().error)
         return -1;
 
       data = read_data() << 8;
@@ -417,7 +427,7 @@ static int isapnp_isolate(void)
     {
       csn++;
 
-      if (isapnp_error)
+      if (state().error)
         return -1;
 
       if (!isapnp_write_byte(0x06, csn))
@@ -435,7 +445,7 @@ static int isapnp_isolate(void)
     }
     if (iteration == 1)
     {
-      isapnp_rdp += RDP_STEP;
+      state().rdp += RDP_STEP;
       if (isapnp_isolate_rdp_select() < 0)
         return -1;
     }
@@ -1036,12 +1046,12 @@ static int isapnp_build_device_list(hwNode & n)
       snprintf(number, sizeof(number), "%ld", serial);
       card.setSerial(number);
     }
-    isapnp_checksum_value = 0x00;
+    state().checksum_value = 0x00;
     isapnp_parse_resource_map(card);
 /*
- * if (isapnp_checksum_value != 0x00)
+ * if (state().checksum_value != 0x00)
  * fprintf(stderr, "isapnp: checksum for device %i is not valid (0x%x)\n",
- * csn, isapnp_checksum_value);
+ * csn, state().checksum_value);
  */
 
     n.addChild(card);
@@ -1062,12 +1072,12 @@ bool scan_isapnp(hwNode & n)
 #ifdef __i386__
   int cards;
 
-  isapnp_rdp = 0;
-  isapnp_detected = 1;
+  state().rdp = 0;
+  state().detected = 1;
   cards = isapnp_isolate();
-  if (cards < 0 || (isapnp_rdp < 0x203 || isapnp_rdp > 0x3ff))
+  if (cards < 0 || (state().rdp < 0x203 || state().rdp > 0x3ff))
   {
-    isapnp_detected = 0;
+    state().detected = 0;
     return false;
   }
 
@@ -19,6 +19,7 @@
 
 #include "version.h"
 #include "options.h"
+#include "context.h"
 #include "mem.h"
 #include "dmi.h"
 #include "cpuinfo.h"
@@ -52,127 +53,380 @@
 #include "abi.h"
 #include "s390.h"
 
+#include "osutils.h"
+
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 __ID("@(#) $Id$");
 
-bool scan_system(hwNode & system)
+/*
+ * each stage of the scan is described by an entry in the table below:
+ * - the status message to display (NULL to keep the previous one)
+ * - the name of the test (as used by -enable/-disable, NULL if the stage
+ *   checks its options itself)
+ * - an optional preparation function that doesn't touch the hardware tree
+ *   (loading ID databases, etc.) and can run on a worker thread
+ * - the scan function itself
+ *
+ * Only the preparation functions run in parallel: they are started on a
+ * bounded pool of threads as soon as the scan begins, so that ID databases
+ * are loaded by the time the stages needing them are reached. The scans
+ * themselves run one at a time, in table order, on the main thread: almost
+ * all of them look up nodes added by earlier stages (core, bus infos, CPUs),
+ * so running them concurrently would need every scanner to build its own
+ * subtree, merged in table order, which none of them does yet.
+ */
+struct scan_stage
 {
-  char hostname[80];
+  const char *status;
+  const char *option;
+  void (*prepare)();
+  bool (*scan)(hwNode &);
+};
 
-  if (gethostname(hostname, sizeof(hostname)) == 0)
+static bool scan_pci_stage(hwNode & n)
+{
+  if (enabled("pci"))
   {
-    hwNode computer(::enabled("output:sanitize")?"computer":hostname,
-      hw::system);
+    if(!scan_pci(n))
+    {
+      if (enabled("pcilegacy"))
+        return scan_pci_legacy(n);
+    }
+    return true;
+  }
+
+  status("PCI (legacy)");
+  if (enabled("pcilegacy"))
+    return scan_pci_legacy(n);
+
+  return false;
+}
+
+static void prepare_pci_stage()
+{
+  if (enabled("pci") || enabled("pcilegacy"))
+    preload_pcidb();
+}
+
+static void prepare_usb_stage()
+{
+  if (enabled("usb"))
+    preload_usbdb();
+}
+
+static const scan_stage stages[] =
+{
+  { "DMI", "dmi", NULL, scan_dmi },
+  { "SMP", "smp", NULL, scan_smp },
+  { "PA-RISC", "parisc", NULL, scan_parisc },
+  { "device-tree", "device-tree", NULL, scan_device_tree },
+  { "SPD", "spd", NULL, scan_spd },
+  { "memory", "memory", NULL, scan_memory },
+  { "/proc/cpuinfo", "cpuinfo", NULL, scan_cpuinfo },
+  { "CPUID", "cpuid", NULL, scan_cpuid },
+  { "PCI (sysfs)", NULL, prepare_pci_stage, scan_pci_stage },
+  { "ISA PnP", "isapnp", NULL, scan_isapnp },
+  { "PnP (sysfs)", "pnp", NULL, scan_pnp },
+  { "PCMCIA", "pcmcia", NULL, scan_pcmcia },
+  { "PCMCIA", "pcmcia-legacy", NULL, scan_pcmcialegacy },
+  { "Virtual I/O (VIRTIO) devices", "virtio", NULL, scan_virtio },
+  { "IBM Virtual I/O (VIO)", "vio", NULL, scan_vio },
+  { "kernel device tree (sysfs)", "sysfs", NULL, scan_sysfs },
+  { "USB", "usb", prepare_usb_stage, scan_usb },
+  { "IDE", "ide", NULL, scan_ide },
+  { NULL, "ideraid", NULL, scan_ideraid },
+  { "SCSI", "scsi", NULL, scan_scsi },
+  { "NVMe", "nvme", NULL, scan_nvme },
+  { "MMC", "mmc", NULL, scan_mmc },
+  { "sound", "sound", NULL, scan_sound },
+  { "graphics", "graphics", NULL, scan_graphics },
+  { "input", "input", NULL, scan_input },
+  { "S/390 devices", "s390", NULL, scan_s390_devices },
+  { NULL, "mounts", NULL, scan_mounts },
+  { "Network interfaces", "network", NULL, scan_network },
+  { "Framebuffer devices", "fb", NULL, scan_fb },
+  { "Display", "display", NULL, scan_display },
+  { "CPUFreq", "cpufreq", NULL, scan_cpufreq },
+  { "ABI", "abi", NULL, scan_abi },
+};
+
+#define NSTAGES (sizeof(stages)/sizeof(stages[0]))
+
+static string stagename(const scan_stage & s)
+{
+  return s.option?s.option:"pci";
+}
+
+// what -timing and -trace report for each scan (or preparation job)
+struct stage_timing
+{
+  string name;
+  unsigned int thread;                            // 0 is the main thread
+  double start;                                   // since the scan began
+  double wall;
+  double cpu;
+  long nodes;                                     // -1 for preparation jobs
+  iostats io;
+};
+
+static double seconds(clockid_t clock)
+{
+  struct timespec ts;
+
+  if (clock_gettime(clock, &ts) != 0)
+    return 0;
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long countnodes(hwNode & n)
+{
+  long result = 1;
+
+  for (unsigned int i = 0; i < n.countChildren(); i++)
+    result += countnodes(*n.getChild(i));
+
+  return result;
+}
+
+class stage_runner
+{
+  public:
+
+    stage_runner(scan_context & c):
+      ctx(c),
+      next(0),
+      timing(enabled("output:timing") || enabled("output:trace")),
+      epoch(seconds(CLOCK_MONOTONIC))
+    {
+      for (size_t i = 0; i < NSTAGES; i++)
+        prepared.push_back(stages[i].prepare == NULL);
+    }
 
-    status("DMI");
-    if (enabled("dmi"))
-      scan_dmi(computer);
-    status("SMP");
-    if (enabled("smp"))
-      scan_smp(computer);
-    status("PA-RISC");
-    if (enabled("parisc"))
-      scan_parisc(computer);
-    status("device-tree");
-    if (enabled("device-tree"))
-      scan_device_tree(computer);
-    status("SPD");
-    if (enabled("spd"))
-      scan_spd(computer);
-    status("memory");
-    if (enabled("memory"))
-      scan_memory(computer);
-    status("/proc/cpuinfo");
-    if (enabled("cpuinfo"))
-      scan_cpuinfo(computer);
-    status("CPUID");
-    if (enabled("cpuid"))
-      scan_cpuid(computer);
-    status("PCI (sysfs)");
-    if (enabled("pci"))
+    ~stage_runner()
     {
-      if(!scan_pci(computer))
+      for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+    }
+
+    void start()
+    {
+      unsigned int jobs = 0;
+      unsigned int nthreads = thread::hardware_concurrency();
+
+      for (size_t i = 0; i < NSTAGES; i++)
+        if (stages[i].prepare)
+          jobs++;
+
+      if (nthreads == 0)
+        nthreads = 1;
+      if (nthreads > MAXTHREADS)
+        nthreads = MAXTHREADS;
+      if (nthreads > jobs)
+        nthreads = jobs;
+
+      for (unsigned int i = 0; i < nthreads; i++)
+        workers.push_back(thread(&stage_runner::work, this, i + 1));
+    }
+
+    void run(hwNode & n)
+    {
+      for (size_t stage = 0; stage < NSTAGES; stage++)
       {
-        if (enabled("pcilegacy"))
-          scan_pci_legacy(computer);
+        const scan_stage & s = stages[stage];
+
+        if (s.status)
+          status(s.status);
+        wait(stage);
+        if (!s.option || enabled(s.option))
+        {
+          stage_timing t;
+          long before = timing ? countnodes(n) : 0;
+
+          starttimer(t, stagename(s), 0);
+          s.scan(n);
+          if (timing)
+            t.nodes = countnodes(n) - before;
+          stoptimer(t);
+        }
       }
+      status("");
     }
-    else
+
+    void report() const
     {
-      status("PCI (legacy)");
-      if (enabled("pcilegacy"))
-        scan_pci_legacy(computer);
+      if (enabled("output:timing"))
+        printtimings();
+      if (enabled("output:trace") && getenv("TRACEFILE"))
+        writetrace(getenv("TRACEFILE"));
     }
-    status("ISA PnP");
-    if (enabled("isapnp"))
-      scan_isapnp(computer);
-    status("PnP (sysfs)");
-    if (enabled("pnp"))
-      scan_pnp(computer);
-    status("PCMCIA");
-    if (enabled("pcmcia"))
-      scan_pcmcia(computer);
-    status("PCMCIA");
-    if (enabled("pcmcia-legacy"))
-      scan_pcmcialegacy(computer);
-    status("Virtual I/O (VIRTIO) devices");
-    if (enabled("virtio"))
-      scan_virtio(computer);
-    status("IBM Virtual I/O (VIO)");
-    if (enabled("vio"))
-      scan_vio(computer);
-    status("kernel device tree (sysfs)");
-    if (enabled("sysfs"))
-      scan_sysfs(computer);
-    status("USB");
-    if (enabled("usb"))
-      scan_usb(computer);
-    status("IDE");
-    if (enabled("ide"))
-      scan_ide(computer);
-    if (enabled("ideraid"))
-      scan_ideraid(computer);
-    status("SCSI");
-    if (enabled("scsi"))
-      scan_scsi(computer);
-    status("NVMe");
-    if (enabled("nvme"))
-      scan_nvme(computer);
-    status("MMC");
-    if (enabled("mmc"))
-      scan_mmc(computer);
-    status("sound");
-    if (enabled("sound"))
-      scan_sound(computer);
-    status("graphics");
-    if (enabled("graphics"))
-      scan_graphics(computer);
-    status("input");
-    if (enabled("input"))
-      scan_input(computer);
-    status("S/390 devices");
-    if (enabled("s390"))
-      scan_s390_devices(computer);
-    if (enabled("mounts"))
-      scan_mounts(computer);
-    status("Network interfaces");
-    if (enabled("network"))
-      scan_network(computer);
-    status("Framebuffer devices");
-    if (enabled("fb"))
-      scan_fb(computer);
-    status("Display");
-    if (enabled("display"))
-      scan_display(computer);
-    status("CPUFreq");
-    if (enabled("cpufreq"))
-      scan_cpufreq(computer);
-    status("ABI");
-    if (enabled("abi"))
-      scan_abi(computer);
-    status("");
+
+  private:
+
+    static const unsigned int MAXTHREADS = 4;
+
+    void work(unsigned int id)
+    {
+      context_guard guard(ctx);
+
+      for (;;)
+      {
+        size_t stage = NSTAGES;
+        {
+          lock_guard < mutex > lock(m);
+          while ((next < NSTAGES) && stages[next].prepare == NULL)
+            next++;
+          if (next >= NSTAGES)
+            return;
+          stage = next++;
+        }
+
+        prepare(stage, id);
+      }
+    }
+
+    void prepare(size_t stage, unsigned int id)
+    {
+      stage_timing t;
+
+      starttimer(t, stagename(stages[stage]) + " (prepare)", id);
+      stages[stage].prepare();
+      stoptimer(t);
+
+      {
+        lock_guard < mutex > lock(m);
+        prepared[stage] = true;
+      }
+      cv.notify_all();
+    }
+
+    void wait(size_t stage)
+    {
+      if (workers.empty() && !prepared[stage])  // no worker: prepare inline
+        prepare(stage, 0);
+
+      unique_lock < mutex > lock(m);
+      while (!prepared[stage])
+        cv.wait(lock);
+    }
+
+    void starttimer(stage_timing & t, const string & name, unsigned int id)
+    {
+      t.name = name;
+      t.thread = id;
+      t.nodes = -1;
+      if (!timing)
+        return;
+      t.start = seconds(CLOCK_MONOTONIC) - epoch;
+      t.cpu = seconds(CLOCK_THREAD_CPUTIME_ID);
+      t.io = get_iostats();
+    }
+
+    void stoptimer(stage_timing & t)
+    {
+      if (!timing)
+        return;
+      t.wall = seconds(CLOCK_MONOTONIC) - epoch - t.start;
+      t.cpu = seconds(CLOCK_THREAD_CPUTIME_ID) - t.cpu;
+      t.io = get_iostats() - t.io;
+
+      lock_guard < mutex > lock(m);
+      timings.push_back(t);
+    }
+
+    void printtimings() const
+    {
+      double wall = seconds(CLOCK_MONOTONIC) - epoch;
+      double cpu = 0;
+      iostats io = iostats();
+
+      fprintf(stderr, "%-28s %6s %9s %9s %9s %6s %6s %6s %9s %6s %6s %6s %6s\n", "stage", "thread", "start(s)", "wall(s)", "CPU(s)", "nodes", "opens", "reads", "bytes", "stats", "dirs", "links", "chdirs");
+      for (size_t i = 0; i < timings.size(); i++)
+      {
+        const stage_timing & t = timings[i];
+
+        fprintf(stderr, "%-28s %6u %9.4f %9.4f %9.4f ", t.name.c_str(), t.thread, t.start, t.wall, t.cpu);
+        if (t.nodes >= 0)
+          fprintf(stderr, "%6ld ", t.nodes);
+        else
+          fprintf(stderr, "%6s ", "-");
+        printio(t.io);
+        cpu += t.cpu;
+        io.opens += t.io.opens;
+        io.reads += t.io.reads;
+        io.bytes += t.io.bytes;
+        io.stats += t.io.stats;
+        io.dirs += t.io.dirs;
+        io.links += t.io.links;
+        io.chdirs += t.io.chdirs;
+      }
+      fprintf(stderr, "%-28s %6s %9s %9.4f %9.4f %6s ", "total", "", "", wall, cpu, "");
+      printio(io);
+    }
+
+    static void printio(const iostats & io)
+    {
+      fprintf(stderr, "%6lu %6lu %9llu %6lu %6lu %6lu %6lu\n", io.opens, io.reads, io.bytes, io.stats, io.dirs, io.links, io.chdirs);
+    }
+
+// Chrome trace-event format (chrome://tracing, Perfetto)
+    void writetrace(const char *filename) const
+    {
+      FILE *out = fopen(filename, "w");
+
+      if (!out)
+        return;
+
+      fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+      for (size_t i = 0; i < timings.size(); i++)
+      {
+        const stage_timing & t = timings[i];
+
+        fprintf(out, "  {\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %u, \"ts\": %.0f, \"dur\": %.0f, \"args\": {\"cpu_us\": %.0f",
+          t.name.c_str(), t.nodes >= 0 ? "scan" : "prepare", (int)getpid(), t.thread, t.start * 1e6, t.wall * 1e6, t.cpu * 1e6);
+        if (t.nodes >= 0)
+          fprintf(out, ", \"nodes\": %ld", t.nodes);
+        fprintf(out, ", \"opens\": %lu, \"reads\": %lu, \"bytes\": %llu, \"stats\": %lu, \"dirs\": %lu, \"links\": %lu, \"chdirs\": %lu",
+          t.io.opens, t.io.reads, t.io.bytes, t.io.stats, t.io.dirs, t.io.links, t.io.chdirs);
+        fprintf(out, "}}%s\n", i + 1 < timings.size() ? "," : "");
+      }
+      fprintf(out, "]}\n");
+      fclose(out);
+    }
+
+    scan_context & ctx;
+    vector < bool > prepared;
+    size_t next;
+    bool timing;
+    double epoch;
+    vector < stage_timing > timings;
+    vector < thread > workers;
+    mutex m;
+    condition_variable cv;
+};
+
+bool scan_system(hwNode & system, scan_context & c)
+{
+  char hostname[80];
+  context_guard guard(c);
+
+  c.reset();                                      // forget any previous scan
+
+  if (gethostname(hostname, sizeof(hostname)) == 0)
+  {
+    hwNode computer(::enabled("output:sanitize")?"computer":hostname,
+      hw::system);
+    stage_runner s(c);
+
+    s.start();
+    s.run(computer);
+    s.report();
 
     if (computer.getDescription() == "")
       computer.setDescription("Computer");
@@ -186,3 +440,9 @@ bool scan_system(hwNode & system)
 
   return true;
 }
+
+
+bool scan_system(hwNode & system)
+{
+  return scan_system(system, context());
+}
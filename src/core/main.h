@@ -2,6 +2,8 @@
 #define _MAIN_H_
 
 #include "hw.h"
+#include "context.h"
 
 bool scan_system(hwNode & system);
+bool scan_system(hwNode & system, scan_context & context);
 #endif
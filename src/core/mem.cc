@@ -20,6 +20,7 @@
 #include "config.h"
 #include "sysfs.h"
 #include "mem.h"
+#include "osutils.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -31,7 +32,7 @@ static unsigned long long get_kcore_size()
 {
   struct stat buf;
 
-  if (stat("/proc/kcore", &buf) != 0)
+  if (stat_file("/proc/kcore", &buf) != 0)
     return 0;
   else
     return buf.st_size;
@@ -67,6 +68,7 @@ static unsigned long long get_hotplug_size()
     return 0;
 
   unsigned long long totalsize = 0;
+  sysfs::prefetch(entries, vector < string > (1, "online"));
   for (vector < sysfs::entry >::iterator it = entries.begin();
       it != entries.end(); ++it)
   {
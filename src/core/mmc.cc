@@ -374,7 +374,7 @@ bool scan_mmc(hwNode & n)
         scan_disk(*subdev);
       }
 
-      device->addChild(card);
+      device->addChild(std::move(card));
     }
 
   }
@@ -99,7 +99,7 @@ static bool process_mount(const string & s, hwNode & n)
   if(mount[0][0] != '/')	// devicenode isn't a full path
     return false;
 
-  if(stat(mount[0].c_str(), &buf) != 0)
+  if(stat_file(mount[0], &buf) != 0)
     return false;
 
   if(!S_ISBLK(buf.st_mode))	// we're only interested in block devices
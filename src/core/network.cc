@@ -21,6 +21,7 @@
 #include "sysfs.h"
 #include "options.h"
 #include "heuristics.h"
+#include "context.h"
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <netinet/in.h>
@@ -374,9 +375,19 @@ static string print_ip(struct sockaddr_in *in)
 }
 
 
+// ioctl()s describe the running system, not the one read from -sysroot
+static int probe_socket(int domain)
+{
+  if (!context().sysroot.empty())
+    return open("/dev/null", O_RDONLY | O_CLOEXEC); // all ioctl()s will fail
+
+  return socket(domain, SOCK_DGRAM, 0);
+}
+
+
 static void scan_ip(hwNode & interface)
 {
-  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  int fd = probe_socket(AF_INET);
 
   if (fd >= 0)
   {
@@ -803,7 +814,12 @@ bool scan_network(hwNode & n)
   if (!load_interfaces(interfaces))
     return false;
 
-  int fd = socket(PF_INET, SOCK_DGRAM, 0);
+  vector < sysfs::entry > devices = sysfs::entries_by_class("net");
+  for (unsigned int i = 0; i < devices.size(); i++)
+    devices[i] = devices[i].leaf();
+  sysfs::prefetch(devices, vector < string > (1, "modalias"));
+
+  int fd = probe_socket(PF_INET);
 
   if (fd >= 0)
   {
@@ -821,10 +837,12 @@ bool scan_network(hwNode & n)
       interface.claim();
       interface.addHint("icon", string("network"));
 
-      string businfo = sysfs::entry::byClass("net", interface.getLogicalName()).leaf().businfo();
+      sysfs::entry device = sysfs::entry::byClass("net", interface.getLogicalName());
+      sysfs::entry leaf = device.leaf();
+      string businfo = leaf.businfo();
       if (businfo!="")
         interface.setBusInfo(businfo);
-      interface.setModalias(sysfs::entry::byClass("net", interface.getLogicalName()).leaf().modalias());
+      interface.setModalias(leaf.modalias());
 
 //scan_mii(fd, interface);
       scan_ip(interface);
@@ -919,7 +937,7 @@ bool scan_network(hwNode & n)
           interface.setBusInfo(guessBusInfo(drvinfo.bus_info));
       }
 
-      if(sysfs::entry::byClass("net", interface.getLogicalName()).isvirtual())
+      if(device.isvirtual())
         interface.addCapability("logical", _("Logical interface"));
 
       existing = n.findChildByBusInfo(interface.getBusInfo());
@@ -947,7 +965,7 @@ bool scan_network(hwNode & n)
 // we don't care about loopback and "logical" interfaces
           if (!interface.isCapable("loopback") &&
             !interface.isCapable("logical"))
-            n.addChild(interface);
+            n.addChild(std::move(interface));
         }
       }
     }
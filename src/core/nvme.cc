@@ -21,6 +21,10 @@ bool scan_nvme(hwNode & n)
   if (entries.empty())
     return false;
 
+  const char *attributes[] = { "model", "serial", "firmware_rev", "subsysnqn", "state", "modalias" };
+  sysfs::prefetch(entries,
+    vector < string > (attributes, attributes + sizeof(attributes) / sizeof(attributes[0])));
+
   for (vector < sysfs::entry >::iterator it = entries.begin();
       it != entries.end(); ++it)
   {
@@ -42,6 +46,9 @@ bool scan_nvme(hwNode & n)
     device->setModalias(e.modalias());
 
     vector < sysfs::entry > namespaces = e.devices();
+    const char *nsattributes[] = { "nsid", "wwid" };
+    sysfs::prefetch(namespaces,
+      vector < string > (nsattributes, nsattributes + sizeof(nsattributes) / sizeof(nsattributes[0])));
     for(vector < sysfs::entry >::iterator i = namespaces.begin(); i != namespaces.end(); ++i)
     {
       const sysfs::entry & n = *i;
@@ -62,7 +69,7 @@ bool scan_nvme(hwNode & n)
 	      ns.setLogicalName(n.name());
       ns.setConfig("wwid",::enabled("output:sanitize")?REMOVED:n.string_attr("wwid"));
       scan_disk(ns);
-      device->addChild(ns);
+      device->addChild(std::move(ns));
     }
   }
 
@@ -8,6 +8,7 @@
 #include "version.h"
 #include "options.h"
 #include "osutils.h"
+#include "context.h"
 
 #include <set>
 #include <vector>
@@ -20,20 +21,16 @@ using namespace std;
 
 __ID("@(#) $Id$");
 
-static set < string > disabled_tests;
-static set < string > visible_classes;
-static map < string, string > aliases;
-
 void alias(const char * aname, const char * cname)
 {
-  aliases[lowercase(aname)] = lowercase(cname);
+  context().aliases[lowercase(aname)] = lowercase(cname);
 }
 
 
 static string getcname(const char * aname)
 {
-  if(aliases.find(lowercase(aname)) != aliases.end())
-    return lowercase(aliases[lowercase(aname)]);
+  if(context().aliases.find(lowercase(aname)) != context().aliases.end())
+    return lowercase(context().aliases[lowercase(aname)]);
   else
     return lowercase(aname);
 }
@@ -90,6 +87,43 @@ char *argv[])
       remove_option_argument(i, argc, argv);
     }
 #endif
+    else if (option == "-snapshot")
+    {
+      if (i + 1 >= argc)
+        return false;                             // -snapshot requires an argument
+
+      setenv("SNAPSHOTFILE", argv[i + 1], 1);
+      enable("output:snapshot");
+
+      remove_option_argument(i, argc, argv);
+    }
+    else if (option == "-trace")
+    {
+      if (i + 1 >= argc)
+        return false;                             // -trace requires an argument
+
+      setenv("TRACEFILE", argv[i + 1], 1);
+      enable("output:trace");
+
+      remove_option_argument(i, argc, argv);
+    }
+    else if (option == "-sysroot")
+    {
+      if (i + 1 >= argc)
+        return false;                             // -sysroot requires an argument
+      context().sysroot = argv[i + 1];
+// these probe the running system (ISA ports, framebuffer ioctls)
+      disable("isapnp");
+      disable("fb");
+      remove_option_argument(i, argc, argv);
+    }
+    else if (option == "-capture")
+    {
+      if (i + 1 >= argc)
+        return false;                             // -capture requires an argument
+      context().capture = argv[i + 1];
+      remove_option_argument(i, argc, argv);
+    }
     else if ( (option == "-class") || (option == "-C") || (option == "-c"))
     {
       vector < string > classes;
@@ -102,7 +136,7 @@ char *argv[])
       splitlines(argv[i + 1], classes, ',');
 
       for (unsigned int j = 0; j < classes.size(); j++)
-        visible_classes.insert(getcname(classes[j].c_str()));
+        context().visible_classes.insert(getcname(classes[j].c_str()));
 
       remove_option_argument(i, argc, argv);
     }
@@ -122,7 +156,7 @@ bool enabled(const char *option)
 
 bool disabled(const char *option)
 {
-  return disabled_tests.find(lowercase(option)) != disabled_tests.end();
+  return context().disabled_tests.find(lowercase(option)) != context().disabled_tests.end();
 }
 
 
@@ -131,19 +165,19 @@ void enable(const char *option)
   if (!disabled(option))
     return;
 
-  disabled_tests.erase(lowercase(option));
+  context().disabled_tests.erase(lowercase(option));
 }
 
 
 void disable(const char *option)
 {
-  disabled_tests.insert(lowercase(option));
+  context().disabled_tests.insert(lowercase(option));
 }
 
 
 bool visible(const char *c)
 {
-  if (visible_classes.size() == 0)
+  if (context().visible_classes.size() == 0)
     return true;
-  return visible_classes.find(getcname(c)) != visible_classes.end();
+  return context().visible_classes.find(getcname(c)) != context().visible_classes.end();
 }
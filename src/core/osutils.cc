@@ -1,11 +1,17 @@
 #include "version.h"
 #include "osutils.h"
+#include "context.h"
 #include <sstream>
 #include <iomanip>
-#include <stack>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <mutex>
+#include <stddef.h>
 #include <cstring>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <limits.h>
@@ -25,51 +31,335 @@
 #ifdef ZLIB
 #include <zlib.h>
 #endif
+#ifdef IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
 
 __ID("@(#) $Id$");
 
 using namespace std;
 
-static stack < string > dirs;
+// per thread, so that work done in the background isn't charged to a scan
+static thread_local iostats counters;
 
-bool pushd(const string & dir)
+iostats get_iostats()
+{
+  return counters;
+}
+
+iostats operator -(const iostats & a, const iostats & b)
 {
-  string curdir = pwd();
+  iostats result;
 
-  if (dir == "")
+  result.opens = a.opens - b.opens;
+  result.reads = a.reads - b.reads;
+  result.bytes = a.bytes - b.bytes;
+  result.stats = a.stats - b.stats;
+  result.dirs = a.dirs - b.dirs;
+  result.links = a.links - b.links;
+  result.chdirs = a.chdirs - b.chdirs;
+
+  return result;
+}
+
+/*
+ * pushd()/popd() don't chdir(): each thread keeps a stack of open
+ * directories and the helpers below resolve relative paths from the top one
+ * with the *at() system calls
+ */
+static bool alphaorder(const struct dirent *a, const struct dirent *b)
+{
+  return strcoll(a->d_name, b->d_name) < 0;
+}
+
+struct heldir
+{
+  int fd;
+  string path;
+};
+
+static thread_local vector < heldir > dirs;
+
+static int curdirfd()
+{
+  return dirs.empty() ? AT_FDCWD : dirs.back().fd;
+}
+
+/*
+ * -sysroot and -capture: the files describing the system itself (not lshw's
+ * own data files) can be read from, or copied to, another directory
+ */
+static bool systempath(const string & path)
+{
+  static const char *prefixes[] =
   {
-    if (dirs.size() == 0)
+    "/sys", "/proc", "/dev", "/etc", "/var/lib", NULL
+  };
+
+  for (const char **p = prefixes; *p; p++)
+  {
+    size_t len = strlen(*p);
+
+    if ((path.compare(0, len, *p) == 0) &&
+      ((path.length() == len) || (path[len] == '/')))
       return true;
+  }
+
+  return false;
+}
+
+string rootpath(const string & path)
+{
+  const string & sysroot = context().sysroot;
+
+  if (sysroot.empty() || !systempath(path))
+    return path;
+
+  return sysroot + path;
+}
+
+// the reverse of rootpath() for a resolved path
+static string unrootpath(const string & path)
+{
+  char buffer[PATH_MAX+1];
+
+  if (context().sysroot.empty() || !::realpath(context().sysroot.c_str(), buffer))
+    return path;
+
+  string root(buffer);
+  if (path == root)
+    return "/";
+  if (path.compare(0, root.length() + 1, root + "/") == 0)
+    return path.substr(root.length());
+  return path;
+}
 
-    if (chdir(dirs.top().c_str()) == 0)
+// the path as given to pushd() and the helpers below
+static string logicalpath(const string & path)
+{
+  if ((path != "") && (path[0] != '/') && !dirs.empty())
+    return dirs.back().path + "/" + path;
+  return path;
+}
+
+struct capture_state
+{
+  capture_state(): incomplete(false) {}
+
+  mutex lock;
+  set < string > seen, copied;
+  bool incomplete;                                // something couldn't be written
+};
+
+static void capture_dirs(const string & dir, const string & path)
+{
+  size_t slash = path.rfind('/');
+
+  if ((slash == string::npos) || (slash == 0))
+    return;
+
+  string parent = path.substr(0, slash);
+  struct stat buf;
+
+  if (stat((dir + parent).c_str(), &buf) == 0)
+    return;
+  capture_dirs(dir, parent);
+  mkdir((dir + parent).c_str(), 0755);
+}
+
+// false if the copy couldn't be written
+static bool capture_file(const string & dir, const string & path, bool contents, const struct stat & info)
+{
+  int out = -1;
+  bool ok = true;
+
+  if (!contents)
+  {
+    out = open((dir + path).c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (out < 0)
+      return errno == EEXIST;                     // already there
+    ok = (ftruncate(out, info.st_size) == 0);     // same size, but sparse
+    close(out);
+    return ok;
+  }
+
+  int in = open(rootpath(path).c_str(), O_RDONLY | O_CLOEXEC);
+  if (in < 0)
+    return false;
+  out = open((dir + path).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (out < 0)
+    ok = false;
+  else
+  {
+    char buffer[4096];
+    ssize_t count = 0;
+    off_t total = 0;
+
+    while (((count = read(in, buffer, sizeof(buffer))) > 0) &&
+      (total < 64 * 1024 * 1024))
     {
-      dirs.pop();
-      dirs.push(curdir);
-      return true;
+      ssize_t i = 0;
+
+      while ((i < count) && !buffer[i])
+        i++;
+      if (i == count)                             // keep holes (sparse files)
+        ok = (lseek(out, count, SEEK_CUR) >= 0);
+      else
+        ok = (write(out, buffer, count) == count);
+      if (!ok)
+        break;
+      total += count;
+    }
+    if (ok)
+      ok = (ftruncate(out, total) == 0);
+    close(out);
+  }
+  close(in);
+
+  return ok;
+}
+
+/*
+ * copies path (as found under -sysroot, if any) to the -capture directory:
+ * every directory and symlink leading to it, and the file itself (its
+ * contents only when they were read); device nodes can't be copied
+ */
+static void capture(const string & path, bool contents)
+{
+  const string & dir = context().capture;
+
+  if (dir.empty())
+    return;
+
+  string logical = logicalpath(path);
+  if (!systempath(logical))
+    return;
+
+  capture_state & c = context().state<capture_state>();
+  lock_guard < mutex > lock(c.lock);
+
+  if (contents ? c.copied.count(logical) : c.seen.count(logical))
+    return;
+  c.seen.insert(logical);
+  if (contents)
+    c.copied.insert(logical);
+
+  vector < string > todo, components;
+  string current = "";
+  unsigned int links = 0;
+
+  splitlines(logical, components, '/');
+  todo.assign(components.rbegin(), components.rend());
+  while (!todo.empty())
+  {
+    string name = todo.back();
+    struct stat buf;
+
+    todo.pop_back();
+    if ((name == "") || (name == "."))
+      continue;
+    if (name == "..")
+    {
+      current = current.substr(0, current.rfind('/'));
+      continue;
+    }
+
+    string next = current + "/" + name;
+    if (lstat(rootpath(next).c_str(), &buf) != 0)
+      return;
+
+    capture_dirs(dir, next);
+    if (S_ISLNK(buf.st_mode))
+    {
+      char target[PATH_MAX+1];
+      ssize_t len = ::readlink(rootpath(next).c_str(), target, sizeof(target) - 1);
+
+      if ((len <= 0) || (++links > 40))
+        return;
+      target[len] = '\0';
+
+      string link(target);
+      if (link[0] == '/')                         // make it relative to the archive
+      {
+        string up = "";
+
+        for (size_t i = 1; i < next.length(); i++)
+          if (next[i] == '/')
+            up += "../";
+        link = up + link.substr(1);
+        current = "";
+      }
+      if ((symlink(link.c_str(), (dir + next).c_str()) != 0) && (errno != EEXIST))
+        c.incomplete = true;
+
+      splitlines(target, components, '/');
+      todo.insert(todo.end(), components.rbegin(), components.rend());
+      continue;
+    }
+
+    if (S_ISDIR(buf.st_mode))
+    {
+      if ((mkdir((dir + next).c_str(), 0755) != 0) && (errno != EEXIST))
+        c.incomplete = true;
     }
     else
-      return false;
+    if (S_ISREG(buf.st_mode) && !capture_file(dir, next, contents && todo.empty(), buf))
+      c.incomplete = true;
+    current = next;
   }
+}
 
-  if (chdir(dir.c_str()) == 0)
+bool pushd(const string & dir)
+{
+  counters.chdirs++;
+  if (dir == "")
   {
-    dirs.push(curdir);
+    if (dirs.size() == 0)
+      return true;
+
+    if (dirs.size() == 1)                         // swap with the process' directory
+    {
+      heldir cwd;
+
+      cwd.fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (cwd.fd < 0)
+        return false;
+      cwd.path = "";
+      dirs.insert(dirs.begin(), cwd);
+    }
+
+    swap(dirs[dirs.size() - 1], dirs[dirs.size() - 2]);
     return true;
   }
-  else
+
+  heldir d;
+
+  d.fd = openat(curdirfd(), rootpath(dir).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (d.fd < 0)
     return false;
+  capture(dir, false);
+
+  if ((dir[0] == '/') || dirs.empty())
+    d.path = dir;
+  else
+    d.path = dirs.back().path + "/" + dir;
+  dirs.push_back(d);
+
+  return true;
 }
 
 
 string popd()
 {
-  string curdir = pwd();
-
   if (dirs.size() == 0)
-    return curdir;
+    return pwd();
+
+  string curdir = dirs.back().path;
 
-  if (chdir(dirs.top().c_str()) == 0)
-    dirs.pop();
+  counters.chdirs++;
+  close(dirs.back().fd);
+  dirs.pop_back();
 
   return curdir;
 }
@@ -79,6 +369,18 @@ string pwd()
 {
   char curdir[PATH_MAX + 1];
 
+  if (!dirs.empty())
+  {
+    char link[64];
+    ssize_t len;
+
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", dirs.back().fd);
+    len = readlink(link, curdir, sizeof(curdir) - 1);
+    if (len > 0)
+      return unrootpath(string(curdir, len));
+    return dirs.back().path;
+  }
+
   if (getcwd(curdir, sizeof(curdir)))
     return string(curdir);
   else
@@ -86,6 +388,73 @@ string pwd()
 }
 
 
+int open_file(const string & path, int flags)
+{
+  int fd = -1;
+
+  counters.opens++;
+  fd = openat(curdirfd(), rootpath(path).c_str(), flags | O_CLOEXEC);
+  if ((fd >= 0) && ((flags & O_ACCMODE) == O_RDONLY))
+    capture(path, true);
+  return fd;
+}
+
+
+void capture_data(const string & path, const string & data)
+{
+  const string & dir = context().capture;
+
+  if (dir.empty())
+    return;
+
+  string logical = logicalpath(path);
+  if (!systempath(logical))
+    return;
+
+  capture_state & c = context().state<capture_state>();
+  lock_guard < mutex > lock(c.lock);
+
+  capture_dirs(dir, logical);
+  int out = open((dir + logical).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if ((out < 0) || (write(out, data.data(), data.length()) != (ssize_t) data.length()))
+    c.incomplete = true;
+  if (out >= 0)
+    close(out);
+}
+
+bool capture_complete()
+{
+  return !context().state<capture_state>().incomplete;
+}
+
+FILE * fopen_file(const string & path)
+{
+  int fd = open_file(path, O_RDONLY);
+  FILE *result = NULL;
+
+  if (fd < 0)
+    return NULL;
+
+  result = fdopen(fd, "r");
+  if (!result)
+    close(fd);
+
+  return result;
+}
+
+
+int stat_file(const string & path, struct stat *buf, bool follow)
+{
+  int result = -1;
+
+  counters.stats++;
+  result = fstatat(curdirfd(), rootpath(path).c_str(), buf, follow ? 0 : AT_SYMLINK_NOFOLLOW);
+  if (result == 0)
+    capture(path, false);
+  return result;
+}
+
+
 size_t splitlines(const string & s,
 vector < string > &lines,
 char separator)
@@ -114,7 +483,11 @@ char separator)
 
 bool exists(const string & path)
 {
-  return access(path.c_str(), F_OK) == 0;
+  counters.stats++;
+  if (faccessat(curdirfd(), rootpath(path).c_str(), F_OK, 0) != 0)
+    return false;
+  capture(path, false);
+  return true;
 }
 
 
@@ -123,12 +496,12 @@ bool exists(const string & path)
 typedef gzFile data_file;
 static data_file file_open(const string & file)
 {
-  data_file result = gzopen((file + ".gz").c_str(), "rb");
-  if (!result)
+  int fd = openat(curdirfd(), rootpath(file + ".gz").c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
   {
-    result = gzopen(file.c_str(), "rb");
+    fd = openat(curdirfd(), rootpath(file).c_str(), O_RDONLY | O_CLOEXEC);
   }
-  return result;
+  return fd < 0 ? NULL : gzdopen(fd, "rb");
 }
 #define file_open_error(f) ((f) == NULL)
 #define file_read(f, b, l) gzread((f), (b), (l))
@@ -137,7 +510,7 @@ static data_file file_open(const string & file)
 #else
 
 typedef int data_file;
-#define file_open(f) open((f).c_str(), O_RDONLY);
+#define file_open(f) openat(curdirfd(), rootpath(f).c_str(), O_RDONLY | O_CLOEXEC);
 #define file_open_error(f) ((f) < 0)
 #define file_read(f, b, l) read((f), (b), (l))
 #define file_close(f) close(f)
@@ -152,15 +525,87 @@ vector < string > &list)
   ssize_t count = 0;
   data_file fd = file_open(file);
 
+  counters.opens++;
   if (file_open_error(fd))
     return false;
 
   while ((count = file_read(fd, buffer, sizeof(buffer))) > 0)
+  {
+    counters.reads++;
+    counters.bytes += count;
     buffer_str += string(buffer, count);
+  }
 
   splitlines(buffer_str, list);
 
   file_close(fd);
+  capture(file, true);
+
+  return true;
+}
+
+
+bool mapfile(const string & file,
+const char * & data,
+size_t & size)
+{
+  struct stat buf;
+  int fd = -1;
+
+#ifdef ZLIB
+  if (exists(file + ".gz"))                       // can't be mapped as is
+  {
+    char buffer[1024];
+    ssize_t count = 0;
+    string *contents = NULL;
+    data_file f = file_open(file);
+
+    counters.opens++;
+    if (file_open_error(f))
+      return false;
+
+    contents = new string;
+    while ((count = file_read(f, buffer, sizeof(buffer))) > 0)
+    {
+      counters.reads++;
+      counters.bytes += count;
+      *contents += string(buffer, count);
+    }
+    file_close(f);
+
+    data = contents->data();
+    size = contents->size();
+    return true;
+  }
+#endif
+
+  fd = openat(curdirfd(), rootpath(file).c_str(), O_RDONLY | O_CLOEXEC);
+  counters.opens++;
+  if (fd < 0)
+    return false;
+  capture(file, true);
+
+  if (fstat(fd, &buf) != 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  size = buf.st_size;
+  data = "";
+  if (size > 0)
+  {
+    void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (p == MAP_FAILED)
+    {
+      close(fd);
+      return false;
+    }
+    data = (const char *)p;
+    counters.bytes += size;
+  }
+  close(fd);
 
   return true;
 }
@@ -169,11 +614,13 @@ vector < string > &list)
 string get_string(const string & path,
 const string & def)
 {
-  int fd = open(path.c_str(), O_RDONLY);
+  int fd = openat(curdirfd(), rootpath(path).c_str(), O_RDONLY | O_CLOEXEC);
   string result = def;
 
+  counters.opens++;
   if (fd >= 0)
   {
+    capture(path, true);
     char buffer[1024];
     ssize_t count = 0;
 
@@ -181,7 +628,11 @@ const string & def)
     result = "";
 
     while ((count = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+      counters.reads++;
+      counters.bytes += count;
       result += string(buffer, count);
+    }
 
     close(fd);
   }
@@ -189,6 +640,261 @@ const string & def)
   return result;
 }
 
+bool get_attribute(const string & path, string & value)
+{
+  int fd = openat(curdirfd(), rootpath(path).c_str(), O_RDONLY | O_CLOEXEC);
+  char buffer[4096];
+  ssize_t count = 0;
+
+  counters.opens++;
+  if (fd < 0)
+    return false;
+  capture(path, true);
+
+  value = "";
+  count = pread(fd, buffer, sizeof(buffer), 0);
+  if (count > 0)
+  {
+    counters.reads++;
+    counters.bytes += count;
+    value.assign(buffer, count);
+  }
+
+  if (count == (ssize_t)sizeof(buffer))           // not an attribute after all
+    while ((count = pread(fd, buffer, sizeof(buffer), value.length())) > 0)
+    {
+      counters.reads++;
+      counters.bytes += count;
+      value.append(buffer, count);
+    }
+
+  close(fd);
+  return true;
+}
+
+#ifdef IO_URING
+#define URING_ENTRIES 256
+#define URING_BUFSIZE 4096
+
+struct uring
+{
+  int fd;
+  void *sq, *cq;
+  size_t sqsize, cqsize, sqesize;
+  unsigned *sqhead, *sqtail, *sqmask, *sqarray;
+  unsigned *cqhead, *cqtail, *cqmask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+};
+
+static bool uring_setup(uring & r)
+{
+  struct io_uring_params p;
+
+  memset(&p, 0, sizeof(p));
+  r.fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+  if (r.fd < 0)
+    return false;
+
+  r.sqsize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r.cqsize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  r.sqesize = p.sq_entries * sizeof(struct io_uring_sqe);
+  r.sq = mmap(NULL, r.sqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r.fd, IORING_OFF_SQ_RING);
+  r.cq = mmap(NULL, r.cqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r.fd, IORING_OFF_CQ_RING);
+  r.sqes = (struct io_uring_sqe *)mmap(NULL, r.sqesize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r.fd, IORING_OFF_SQES);
+  if ((r.sq == MAP_FAILED) || (r.cq == MAP_FAILED) || (r.sqes == MAP_FAILED))
+  {
+    if (r.sq != MAP_FAILED) munmap(r.sq, r.sqsize);
+    if (r.cq != MAP_FAILED) munmap(r.cq, r.cqsize);
+    if (r.sqes != MAP_FAILED) munmap(r.sqes, r.sqesize);
+    close(r.fd);
+    return false;
+  }
+
+  r.sqhead = (unsigned *)((char *)r.sq + p.sq_off.head);
+  r.sqtail = (unsigned *)((char *)r.sq + p.sq_off.tail);
+  r.sqmask = (unsigned *)((char *)r.sq + p.sq_off.ring_mask);
+  r.sqarray = (unsigned *)((char *)r.sq + p.sq_off.array);
+  r.cqhead = (unsigned *)((char *)r.cq + p.cq_off.head);
+  r.cqtail = (unsigned *)((char *)r.cq + p.cq_off.tail);
+  r.cqmask = (unsigned *)((char *)r.cq + p.cq_off.ring_mask);
+  r.cqes = (struct io_uring_cqe *)((char *)r.cq + p.cq_off.cqes);
+  return true;
+}
+
+static void uring_close(uring & r)
+{
+  munmap(r.sqes, r.sqesize);
+  munmap(r.cq, r.cqsize);
+  munmap(r.sq, r.sqsize);
+  close(r.fd);
+}
+
+// runs (at most URING_ENTRIES) requests and waits for all of them
+static bool uring_run(uring & r, const vector < struct io_uring_sqe > & requests, vector < int > & results)
+{
+  unsigned tail = *r.sqtail;
+  unsigned done = 0;
+
+  results.assign(requests.size(), -ECANCELED);
+  for (unsigned i = 0; i < requests.size(); i++)
+  {
+    unsigned index = tail & *r.sqmask;
+
+    r.sqes[index] = requests[i];
+    r.sqes[index].user_data = i;
+    r.sqarray[index] = index;
+    tail++;
+  }
+  __atomic_store_n(r.sqtail, tail, __ATOMIC_RELEASE);
+
+  unsigned submit = requests.size();
+  while (done < requests.size())
+  {
+    int n = syscall(__NR_io_uring_enter, r.fd, submit, requests.size() - done, IORING_ENTER_GETEVENTS, NULL, 0);
+
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    submit -= (unsigned)n < submit ? n : submit;
+
+    unsigned head = *r.cqhead;
+    while (head != __atomic_load_n(r.cqtail, __ATOMIC_ACQUIRE))
+    {
+      const struct io_uring_cqe & cqe = r.cqes[head & *r.cqmask];
+
+      if (cqe.user_data < results.size())
+        results[cqe.user_data] = cqe.res;
+      head++;
+      done++;
+    }
+    __atomic_store_n(r.cqhead, head, __ATOMIC_RELEASE);
+  }
+
+  return true;
+}
+
+/*
+ * opens, reads and closes a batch of files with one system call each;
+ * anything io_uring can't do (old kernel...) is done again by get_attribute()
+ */
+static bool uring_attributes(uring & r, const vector < string > & paths, map < string, string > & values)
+{
+  vector < struct io_uring_sqe > requests(paths.size());
+  vector < int > fds, counts, results;
+  vector < char > buffers(paths.size() * URING_BUFSIZE);
+  vector < string > realpaths(paths.size());
+
+  for (unsigned i = 0; i < paths.size(); i++)
+  {
+    realpaths[i] = rootpath(paths[i]);
+    memset(&requests[i], 0, sizeof(requests[i]));
+    requests[i].opcode = IORING_OP_OPENAT;
+    requests[i].fd = curdirfd();
+    requests[i].addr = (uintptr_t)realpaths[i].c_str();
+    requests[i].open_flags = O_RDONLY | O_CLOEXEC;
+  }
+  if (!uring_run(r, requests, fds))
+    return false;
+  counters.opens += paths.size();
+
+  for (unsigned i = 0; i < paths.size(); i++)
+  {
+    memset(&requests[i], 0, sizeof(requests[i]));
+    requests[i].opcode = (fds[i] >= 0) ? IORING_OP_READ : IORING_OP_NOP;
+    requests[i].fd = fds[i];
+    requests[i].addr = (uintptr_t)&buffers[i * URING_BUFSIZE];
+    requests[i].len = URING_BUFSIZE;
+  }
+  if (!uring_run(r, requests, counts))
+    counts.assign(paths.size(), -ECANCELED);
+
+  for (unsigned i = 0; i < paths.size(); i++)
+  {
+    string value;
+
+    if (fds[i] < 0)
+    {
+      if ((fds[i] != -ENOENT) && (fds[i] != -EACCES) && get_attribute(paths[i], value))
+        values[paths[i]] = value;
+      continue;
+    }
+
+    if (counts[i] < 0)                            // no IORING_OP_READ?
+    {
+      if (get_attribute(paths[i], value))
+        values[paths[i]] = value;
+      continue;
+    }
+
+    capture(paths[i], true);
+    counters.reads++;
+    counters.bytes += counts[i];
+    value.assign(&buffers[i * URING_BUFSIZE], counts[i]);
+    if (counts[i] == URING_BUFSIZE)               // there's more
+    {
+      char buffer[URING_BUFSIZE];
+      ssize_t count = 0;
+
+      while ((count = pread(fds[i], buffer, sizeof(buffer), value.length())) > 0)
+      {
+        counters.reads++;
+        counters.bytes += count;
+        value.append(buffer, count);
+      }
+    }
+    values[paths[i]] = value;
+  }
+
+  for (unsigned i = 0; i < paths.size(); i++)
+  {
+    memset(&requests[i], 0, sizeof(requests[i]));
+    requests[i].opcode = (fds[i] >= 0) ? IORING_OP_CLOSE : IORING_OP_NOP;
+    requests[i].fd = fds[i];
+  }
+  if (!uring_run(r, requests, results))
+    results.assign(paths.size(), -ECANCELED);
+  for (unsigned i = 0; i < paths.size(); i++)
+    if ((fds[i] >= 0) && (results[i] < 0) && (results[i] != -EBADF))
+      close(fds[i]);                              // no IORING_OP_CLOSE
+
+  return true;
+}
+#endif
+
+void get_attributes(const vector < string > & paths, map < string, string > & values)
+{
+  unsigned int i = 0;
+
+#ifdef IO_URING
+  uring r;
+
+  if ((paths.size() >= 8) && uring_setup(r))
+  {
+    for (; i < paths.size(); i += URING_ENTRIES)
+    {
+      vector < string > batch(paths.begin() + i,
+        paths.begin() + min(paths.size(), (size_t)i + URING_ENTRIES));
+
+      if (!uring_attributes(r, batch, values))
+        break;
+    }
+    uring_close(r);
+  }
+#endif
+
+  for (; i < paths.size(); i++)
+  {
+    string value;
+
+    if (get_attribute(paths[i], value))
+      values[paths[i]] = value;
+  }
+}
+
 long get_number(const string & path, long def)
 {
   string s = get_string(path, "");
@@ -205,7 +911,8 @@ int selectdir(const struct dirent *d)
   if (d->d_name[0] == '.')
     return 0;
 
-  if (lstat(d->d_name, &buf) != 0)
+  counters.stats++;
+  if (fstatat(curdirfd(), d->d_name, &buf, AT_SYMLINK_NOFOLLOW) != 0)
     return 0;
 
   return S_ISDIR(buf.st_mode);
@@ -219,7 +926,8 @@ int selectlink(const struct dirent *d)
   if (d->d_name[0] == '.')
     return 0;
 
-  if (lstat(d->d_name, &buf) != 0)
+  counters.stats++;
+  if (fstatat(curdirfd(), d->d_name, &buf, AT_SYMLINK_NOFOLLOW) != 0)
     return 0;
 
   return S_ISLNK(buf.st_mode);
@@ -232,12 +940,75 @@ int selectfile(const struct dirent *d)
   if (d->d_name[0] == '.')
     return 0;
 
-  if (lstat(d->d_name, &buf) != 0)
+  counters.stats++;
+  if (fstatat(curdirfd(), d->d_name, &buf, AT_SYMLINK_NOFOLLOW) != 0)
     return 0;
 
   return S_ISREG(buf.st_mode);
 }
 
+int scan_dir(const string & path, struct dirent ***namelist, int (*filter)(const struct dirent *))
+{
+  vector < struct dirent * > entries;
+  struct dirent *d = NULL;
+  DIR *dir = NULL;
+  int fd = -1;
+
+  if (path != ".")                                // filters work on the current directory
+  {
+    int result = -1;
+
+    if (pushd(path))
+    {
+      result = scan_dir(".", namelist, filter);
+      popd();
+    }
+    return result;
+  }
+
+  counters.dirs++;
+  fd = openat(curdirfd(), ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  dir = fdopendir(fd);
+  if (!dir)
+  {
+    close(fd);
+    return -1;
+  }
+
+  while ((d = readdir(dir)) != NULL)
+  {
+    if (filter && !filter(d))
+      continue;
+
+    size_t len = offsetof(struct dirent, d_name) + strlen(d->d_name) + 1;
+    struct dirent *entry = (struct dirent *)malloc(sizeof(struct dirent));
+
+    if (!entry)
+      break;
+    memcpy(entry, d, len);
+    entries.push_back(entry);
+  }
+  closedir(dir);
+
+  sort(entries.begin(), entries.end(), alphaorder);
+  for (size_t i = 0; i < entries.size(); i++)
+    capture(entries[i]->d_name, false);
+
+  *namelist = (struct dirent **)malloc((entries.size() + 1) * sizeof(struct dirent *));
+  if (!*namelist)
+  {
+    for (size_t i = 0; i < entries.size(); i++)
+      free(entries[i]);
+    return -1;
+  }
+  for (size_t i = 0; i < entries.size(); i++)
+    (*namelist)[i] = entries[i];
+
+  return entries.size();
+}
+
 static int selectdevice(const struct dirent *d)
 {
   struct stat buf;
@@ -245,7 +1016,8 @@ static int selectdevice(const struct dirent *d)
   if (d->d_name[0] == '.')
     return 0;
 
-  if (lstat(d->d_name, &buf) != 0)
+  counters.stats++;
+  if (fstatat(curdirfd(), d->d_name, &buf, AT_SYMLINK_NOFOLLOW) != 0)
     return 0;
 
   return S_ISCHR(buf.st_mode) || S_ISBLK(buf.st_mode);
@@ -258,7 +1030,8 @@ dev_t device)
 {
   struct stat buf;
 
-  if (lstat(name.c_str(), &buf) != 0)
+  counters.stats++;
+  if (fstatat(curdirfd(), name.c_str(), &buf, AT_SYMLINK_NOFOLLOW) != 0)
     return false;
 
   return ((S_ISCHR(buf.st_mode) && S_ISCHR(mode)) ||
@@ -276,7 +1049,7 @@ dev_t device)
 
   pushd(basepath);
 
-  n = scandir(".", &namelist, selectdevice, alphasort);
+  n = scan_dir(".", &namelist, selectdevice);
 
   if (n < 0)
   {
@@ -298,7 +1071,7 @@ dev_t device)
     return basepath + "/" + result;
 
   pushd(basepath);
-  n = scandir(".", &namelist, selectdir, alphasort);
+  n = scan_dir(".", &namelist, selectdir);
   popd();
 
   if (n < 0)
@@ -329,7 +1102,8 @@ string get_devid(const string & name)
 {
   struct stat buf;
 
-  if((stat(name.c_str(), &buf)==0) && (S_ISBLK(buf.st_mode) || S_ISCHR(buf.st_mode)))
+  counters.stats++;
+  if((fstatat(curdirfd(), rootpath(name).c_str(), &buf, 0)==0) && (S_ISBLK(buf.st_mode) || S_ISCHR(buf.st_mode)))
   {
     char devid[80];
 
@@ -346,10 +1120,13 @@ bool samefile(const string & path1, const string & path2)
   struct stat stat1;
   struct stat stat2;
 
-  if (stat(path1.c_str(), &stat1) != 0)
+  counters.stats += 2;
+  if (fstatat(curdirfd(), rootpath(path1).c_str(), &stat1, 0) != 0)
     return false;
-  if (stat(path2.c_str(), &stat2) != 0)
+  if (fstatat(curdirfd(), rootpath(path2).c_str(), &stat2, 0) != 0)
     return false;
+  capture(path1, false);
+  capture(path2, false);
 
   return (stat1.st_dev == stat2.st_dev) && (stat1.st_ino == stat2.st_ino);
 }
@@ -405,19 +1182,49 @@ string join(const string & j, const string & s1, const string & s2)
 }
 
 
-bool matches(const string & s, const string & pattern, int cflags)
+/*
+ * patterns are compiled once and kept for the whole run: they are all
+ * constants and the same few are tried on every device (regexec() can be
+ * called concurrently on a compiled pattern)
+ */
+struct compiled_regex
 {
+  bool valid;
   regex_t r;
-  bool result = false;
+};
 
-  if(regcomp(&r, pattern.c_str(), REG_EXTENDED | REG_NOSUB | cflags) != 0)
-    return false;
+static struct regex_cache: public map < pair < string, int >, compiled_regex >
+{
+  ~regex_cache()
+  {
+    for (iterator i = begin(); i != end(); i++)
+      if (i->second.valid)
+        regfree(&i->second.r);
+  }
+} regexes;
+static mutex regexes_lock;
 
-  result = (regexec(&r, s.c_str(), 0, NULL, 0) == 0);
+bool matches(const string & s, const string & pattern, int cflags)
+{
+  compiled_regex *r = NULL;
 
-  regfree(&r);
+  {
+    lock_guard < mutex > lock(regexes_lock);
+    map < pair < string, int >, compiled_regex >::iterator i = regexes.find(make_pair(pattern, cflags));
 
-  return result;
+    if (i == regexes.end())
+    {
+      r = &regexes[make_pair(pattern, cflags)];
+      r->valid = (regcomp(&r->r, pattern.c_str(), REG_EXTENDED | REG_NOSUB | cflags) == 0);
+    }
+    else
+      r = &i->second;
+  }
+
+  if (!r->valid)
+    return false;
+
+  return (regexec(&r->r, s.c_str(), 0, NULL, 0) == 0);
 }
 
 
@@ -426,8 +1233,12 @@ string readlink(const string & path)
   char buffer[PATH_MAX+1];
 
   memset(buffer, 0, sizeof(buffer));
-  if(readlink(path.c_str(), buffer, sizeof(buffer)-1)>0)
+  counters.links++;
+  if(readlinkat(curdirfd(), rootpath(path).c_str(), buffer, sizeof(buffer)-1)>0)
+  {
+    capture(path, false);
     return string(buffer);
+  }
   else
     return path;
 }
@@ -438,10 +1249,21 @@ string realpath(const string & path)
   char buffer[PATH_MAX+1];
 
   memset(buffer, 0, sizeof(buffer));
-  if(realpath(path.c_str(), buffer))
-    return string(buffer);
+  counters.links++;
+  if ((path != "") && (path[0] != '/') && !dirs.empty())
+  {
+    char fdpath[64];
+
+    snprintf(fdpath, sizeof(fdpath), "/proc/self/fd/%d/", dirs.back().fd);
+    if(!realpath((fdpath + path).c_str(), buffer))
+      return path;
+  }
   else
+  if(!realpath(rootpath(path).c_str(), buffer))
     return path;
+
+  capture(path, false);
+  return unrootpath(string(buffer));
 }
 
 
@@ -641,6 +1463,7 @@ int open_dev(dev_t dev, int dev_type, const string & name)
     if ((mknod(fn, (dev_type | S_IREAD), dev) == 0) || (errno == EEXIST))
     {
       fd = open(fn, O_RDONLY);
+      counters.opens++;
       if(name=="") unlink(fn);
       if (fd >= 0)
         return fd;
@@ -3,13 +3,28 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <sys/types.h>
 #include <stdint.h>
+#include <stdio.h>
 
 bool pushd(const std::string & dir = "");
 std::string popd();
 std::string pwd();
 
+// like open(), fopen(..., "r") and stat()/lstat() but relative to pushd()
+int open_file(const std::string & path, int flags);
+FILE * fopen_file(const std::string & path);
+int stat_file(const std::string & path, struct stat *buf, bool follow = true);
+// with -capture, appends data to the copy of path: used to record what was
+// read from device files, which can't be copied
+void capture_data(const std::string & path, const std::string & data);
+// false when something couldn't be written to the -capture directory
+bool capture_complete();
+
+// where path really is, i.e. below -sysroot for /sys, /proc, /dev, /etc...
+std::string rootpath(const std::string & path);
+
 bool exists(const std::string & path);
 bool samefile(const std::string & path1, const std::string & path2);
 std::string readlink(const std::string & path);
@@ -17,12 +32,19 @@ std::string realpath(const std::string & path);
 std::string dirname(const std::string & path);
 std::string shortname(const std::string & path);
 bool loadfile(const std::string & file, std::vector < std::string > &lines);
+// whole data file in memory (decompressed if needed), never released
+bool mapfile(const std::string & file, const char * & data, size_t & size);
 
 size_t splitlines(const std::string & s,
 std::vector < std::string > &lines,
 char separator = '\n');
 std::string get_string(const std::string & path, const std::string & def = "");
 long get_number(const std::string & path, long def = 0);
+// like get_string() for sysfs attributes (never more than a page, read at once)
+bool get_attribute(const std::string & path, std::string & value);
+// get_attribute() of many files at once (through io_uring when available);
+// the ones that can't be opened are left out
+void get_attributes(const std::vector < std::string > & paths, std::map < std::string, std::string > & values);
 
 std::string find_deventry(mode_t mode, dev_t device);
 std::string get_devid(const std::string &);
@@ -52,6 +74,24 @@ int selectdir(const struct dirent *d);
 int selectlink(const struct dirent *d);
 int selectfile(const struct dirent *d);
 
+// scandir() of path (relative to pushd()), sorted like alphasort()
+int scan_dir(const std::string & path, struct dirent ***namelist, int (*filter)(const struct dirent *) = NULL);
+
+// I/O done through the helpers above by the calling thread
+struct iostats
+{
+  unsigned long opens;
+  unsigned long reads;
+  unsigned long long bytes;
+  unsigned long stats;
+  unsigned long dirs;                             // directory scans
+  unsigned long links;                            // readlink() and realpath()
+  unsigned long chdirs;                           // pushd() and popd()
+};
+
+iostats get_iostats();
+iostats operator -(const iostats &, const iostats &);
+
 unsigned short be_short(const void *);
 unsigned short le_short(const void *);
 unsigned long be_long(const void *);
@@ -12,6 +12,7 @@
 #include "version.h"
 #include "device-tree.h"
 #include "osutils.h"
+#include "context.h"
 #include "heuristics.h"
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -387,7 +388,7 @@ static const char *cpu_name_version[][2] =
 static long get_long(const string & path)
 {
   long result = -1;
-  FILE * in = fopen(path.c_str(), "r");
+  FILE * in = fopen_file(path);
 
   if (in)
   {
@@ -424,7 +425,17 @@ enum cpu_type parisc_get_cpu_type(long hversion)
 }
 
 
-static int currentcpu = 0;
+struct parisc_state
+{
+  parisc_state(): currentcpu(0) {}
+
+  int currentcpu;
+};
+
+static parisc_state & state()
+{
+  return context().state<parisc_state>();
+}
 
 static hwNode get_device(long hw_type, long sversion, long hversion)
 {
@@ -439,7 +450,7 @@ static hwNode get_device(long hw_type, long sversion, long hversion)
       if(hw_type == TP_NPROC)
       {
         enum cpu_type cpu = parisc_get_cpu_type(hversion);
-        newnode.setBusInfo(cpubusinfo(currentcpu++));
+        newnode.setBusInfo(cpubusinfo(state().currentcpu++));
         newnode.setProduct(cpu_name_version[cpu][0]);
         newnode.setVersion(cpu_name_version[cpu][1]);
       }
@@ -453,7 +464,7 @@ static hwNode get_device(long hw_type, long sversion, long hversion)
     case TP_NPROC:
       newnode = hwNode("cpu", hw::processor);
       newnode.setDescription("Processor");
-      newnode.setBusInfo(cpubusinfo(currentcpu++));
+      newnode.setBusInfo(cpubusinfo(state().currentcpu++));
       break;
     case TP_MEMORY:
       newnode = hwNode("memory", hw::memory);
@@ -555,7 +566,7 @@ static bool scan_device(hwNode & node, string name = "")
     curnode = node.addChild(newnode);
   }
 
-  n = scandir(".", &namelist, selectdir, alphasort);
+  n = scan_dir(".", &namelist, selectdir);
   if (n < 0)
     return false;
   else
@@ -581,7 +592,7 @@ bool scan_parisc(hwNode & node)
 {
   hwNode *core = node.getChild("core");
 
-  currentcpu = 0;
+  state().currentcpu = 0;
 
   if (!core)
   {
@@ -20,6 +20,7 @@
 #include "lvm.h"
 #include "volumes.h"
 #include "osutils.h"
+#include "context.h"
 #include "options.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -292,7 +293,17 @@ static struct systypes dos_sys_types[] =
   { 0, NULL, NULL, NULL }
 };
 
-static unsigned int lastlogicalpart = 5;
+struct partitions_state
+{
+  partitions_state(): lastlogicalpart(5) {}
+
+  unsigned int lastlogicalpart;
+};
+
+static partitions_state & state()
+{
+  return context().state<partitions_state>();
+}
 
 static string partitionname(string disk, unsigned int n)
 {
@@ -424,15 +435,15 @@ hwNode & extpart)
       spart.offset = extendedpart.offset + pte[0].start;
       spart.size = pte[0].size;
 
-      partition.setPhysId(lastlogicalpart);
+      partition.setPhysId(state().lastlogicalpart);
       partition.setCapacity(spart.size);
 
       if(analyse_dospart(spart, pte[0].flags, pte[0].type, partition))
       {
-        guess_logicalname(spart, extpart, lastlogicalpart, partition);
+        guess_logicalname(spart, extpart, state().lastlogicalpart, partition);
 	scan_volume(partition, spart);
-        extpart.addChild(partition);
-        lastlogicalpart++;
+        extpart.addChild(std::move(partition));
+        state().lastlogicalpart++;
       }
     }
 
@@ -1141,7 +1152,7 @@ static bool detect_gpt(source & s, hwNode & n)
       spart.size = (p.EndingLBA - p.StartingLBA)*spart.blocksize;
       guess_logicalname(spart, n, i+1, partition);
       scan_volume(partition, spart);
-      n.addChild(partition);
+      n.addChild(std::move(partition));
     }
   }
 
@@ -1180,7 +1191,7 @@ static bool detect_dosmap(source & s, hwNode & n)
     n.setConfig("signature", buffer);
   }
 
-  lastlogicalpart = 5;
+  state().lastlogicalpart = 5;
 
   for(i=0; i<4; i++)
   {
@@ -1208,7 +1219,7 @@ static bool detect_dosmap(source & s, hwNode & n)
     {
       guess_logicalname(spart, n, i+1, partition);
       scan_volume(partition, spart);
-      n.addChild(partition);
+      n.addChild(std::move(partition));
       partitioned = true;
     }
   }
@@ -1276,7 +1287,7 @@ static bool detect_macmap(source & s, hwNode & n)
       guess_logicalname(spart, n, i, partition);
 
       scan_volume(partition, spart);
-      n.addChild(partition);
+      n.addChild(std::move(partition));
     }
   }
 
@@ -1360,7 +1371,7 @@ static bool detect_luks(source & s, hwNode & n)
     hwNode partition("volume", hw::volume);
     scan_volume(partition, luksvolume);
     partition.setLogicalName(n.getLogicalName());
-    n.addChild(partition);
+    n.addChild(std::move(partition));
   }
 
   return true;
@@ -1370,7 +1381,7 @@ bool scan_partitions(hwNode & n)
 {
   int i = 0;
   source s;
-  int fd = open(n.getLogicalName().c_str(), O_RDONLY | O_NONBLOCK);
+  int fd = open_file(n.getLogicalName(), O_RDONLY | O_NONBLOCK);
   hwNode * medium = NULL;
 
   if (fd < 0)
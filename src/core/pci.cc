@@ -5,6 +5,7 @@
 #include "osutils.h"
 #include "options.h"
 #include "sysfs.h"
+#include "iddb.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -15,6 +16,9 @@
 #include <stdlib.h>
 #include <dirent.h>
 #include <cstring>
+#include <algorithm>
+#include <map>
+#include <mutex>
 
 __ID("@(#) $Id$");
 
@@ -203,7 +207,8 @@ __ID("@(#) $Id$");
 #define PCI_CB_SUBSYSTEM_VENDOR_ID   0x40
 #define PCI_CB_SUBSYSTEM_ID          0x42
 
-bool pcidb_loaded = false;
+static std::once_flag pcidb_once;
+static bool pcidb_compiled = false;               // use ids.db instead
 
 typedef unsigned long long pciaddr_t;
 typedef enum
@@ -247,15 +252,44 @@ struct pci_entry
     long u2 = -1,
     long u3 = -1,
     long u4 = -1);
+};
 
-  unsigned int matches(long u1 = -1,
-    long u2 = -1,
-    long u3 = -1,
-    long u4 = -1);
+/*
+ * entries in file order (earlier ones win ties), plus their positions sorted
+ * by IDs so that lookups don't have to scan the whole list
+ */
+struct pci_catalog
+{
+  vector < pci_entry > entries;
+  vector < unsigned int > order;
+
+  size_t size() const { return entries.size(); }
+  void push_back(const pci_entry & e) { entries.push_back(e); }
+  void sort();
+};
+
+/*
+ * pci.ids files are mapped in memory and only indexed by vendor: the lines
+ * describing a vendor's devices are parsed the first time one of them is
+ * looked up
+ */
+struct pci_block
+{
+  const char *start, *end;
+};
+
+struct pci_vendor
+{
+  vector < pci_block > blocks;                    // in file order
+  bool parsed;
+  pci_catalog devices;
+
+  pci_vendor(): parsed(false) {}
 };
 
-static vector < pci_entry > pci_devices;
-static vector < pci_entry > pci_classes;
+static map < long, pci_vendor > pci_vendors;
+static pci_catalog pci_classes;
+static std::mutex pcidb_lock;
 
 pci_entry::pci_entry(const string & d,
 long u1,
@@ -271,59 +305,84 @@ long u4)
 }
 
 
-unsigned int pci_entry::matches(long u1,
-long u2,
-long u3,
-long u4)
+// compares the first n IDs of a and b
+static int compare_ids(const long *a,
+const long *b,
+unsigned int n)
+{
+  for (unsigned int i = 0; i < n; i++)
+  {
+    if (a[i] < b[i])
+      return -1;
+    if (a[i] > b[i])
+      return 1;
+  }
+
+  return 0;
+}
+
+
+struct ids_less
 {
-  unsigned int result = 0;
+  const vector < pci_entry > & entries;
+  unsigned int n;
+
+  ids_less(const vector < pci_entry > & e, unsigned int len = 4): entries(e), n(len) {}
 
-  if (ids[0] == u1)
+  bool operator()(unsigned int a, unsigned int b) const
   {
-    result++;
-    if (ids[1] == u2)
-    {
-      result++;
-      if (ids[2] == u3)
-      {
-        result++;
-        if (ids[3] == u4)
-          result++;
-      }
-    }
+    return compare_ids(entries[a].ids, entries[b].ids, n) < 0;
   }
 
-  return result;
+  bool operator()(unsigned int a, const long *ids) const
+  {
+    return compare_ids(entries[a].ids, ids, n) < 0;
+  }
+};
+
+
+void pci_catalog::sort()
+{
+  order.resize(entries.size());
+  for (unsigned int i = 0; i < entries.size(); i++)
+    order[i] = i;
+
+  stable_sort(order.begin(), order.end(), ids_less(entries));
 }
 
 
-static bool find_best_match(vector < pci_entry > &list,
+/*
+ * returns the entry sharing the longest prefix of IDs with the ones we look
+ * for (the first one in file order if several do): try the complete
+ * vendor/device/subvendor/subdevice first, then shorter and shorter prefixes
+ */
+static bool find_best_match(pci_catalog & list,
 pci_entry & result,
 long u1 = -1,
 long u2 = -1,
 long u3 = -1,
 long u4 = -1)
 {
-  int lastmatch = -1;
-  unsigned int lastscore = 0;
+  long ids[4] = { u1, u2, u3, u4 };
 
-  for (unsigned int i = 0; i < list.size(); i++)
+  for (unsigned int n = 4; n > 0; n--)
   {
-    unsigned int currentscore = list[i].matches(u1, u2, u3, u4);
+    int lastmatch = -1;
+    vector < unsigned int >::const_iterator i = lower_bound(list.order.begin(),
+      list.order.end(), (const long *)ids, ids_less(list.entries, n));
 
-    if (currentscore > lastscore)
+    for (; (i != list.order.end()) &&
+      (compare_ids(list.entries[*i].ids, ids, n) == 0); i++)
+      if ((lastmatch < 0) || (*i < (unsigned int)lastmatch))
+        lastmatch = *i;
+
+    if (lastmatch >= 0)
     {
-      lastscore = currentscore;
-      lastmatch = i;
+      result = list.entries[lastmatch];
+      return true;
     }
   }
 
-  if (lastmatch >= 0)
-  {
-    result = list[lastmatch];
-    return true;
-  }
-
   return false;
 }
 
@@ -404,141 +463,305 @@ static const char *get_class_name(unsigned int c)
 }
 
 
-static bool parse_pcidb(vector < string > &list)
+static bool is_class_catalog(catalog c)
 {
-  long u[4];
-  string line = "";
-  catalog current_catalog = pcivendor;
-  unsigned int level = 0;
+  return (c == pciclass) || (c == pcisubclass) || (c == pciprogif);
+}
 
-  memset(u, 0, sizeof(u));
 
-  for (unsigned int i = 0; i < list.size(); i++)
+/*
+ * parses the line of pci.ids between start and end and updates the parser's
+ * state; returns -1 if the line is malformed (which ends the file), 0 if
+ * it's empty or a comment
+ *
+ * the description is only built when asked for, so that the files can be
+ * indexed in place
+ */
+static int parse_pcidb_line(const char *start,
+const char *end,
+catalog & current_catalog,
+long u[4],
+string *description = NULL)
+{
+  const char *b = start, *e = end;
+  string line;
+  char id[16];
+  size_t len = 0, skip = 0;
+  unsigned int level = 0;
+  bool clean = (description == NULL);
+
+  while ((start + level < end) && (start[level] == '\t'))
+    level++;
+
+// control characters and non-ASCII IDs need hw::strip()
+  while ((b < e) && ((uint8_t)*b <= ' ') && *b)
+    b++;
+  while ((e > b) && ((uint8_t)e[-1] <= ' ') && e[-1])
+    e--;
+  for (const char *c = start; clean && (c < end); c++)
+    if ((!*c) || (((c >= b) && (c < e)) &&
+      (((uint8_t)*c < ' ') || ((c < b + sizeof(id)) && ((uint8_t)*c >= 0x80)))))
+      clean = false;
+  if (!clean)
   {
-    line = hw::strip(list[i]);
+    line = hw::strip(string(start, end - start));
+    b = line.data();
+    e = b + line.length();
+  }
 
 // ignore empty or commented-out lines
-    if (line.length() == 0 || line[0] == '#')
-      continue;
+  if ((b == e) || (*b == '#'))
+    return 0;
 
-    level = 0;
-    while ((level < list[i].length()) && (list[i][level] == '\t'))
-      level++;
+  len = e - b;
+  memset(id, 0, sizeof(id));
+  memcpy(id, b, min(len, sizeof(id) - 1));
 
-    switch (level)
+  switch (level)
+  {
+    case 0:
+      if ((id[0] == 'C') && (len > 1) && (id[1] == ' '))
+      {
+        current_catalog = pciclass;
+        if ((len < 5) || (id[4] != ' ') || (sscanf(id + 2, "%lx", &u[0]) != 1))
+          return -1;
+      }
+      else
+      {
+        current_catalog = pcivendor;
+        if ((len < 5) || (id[4] != ' ') || (sscanf(id, "%lx", &u[0]) != 1))
+          return -1;
+      }
+      skip = 5;
+      u[1] = u[2] = u[3] = -1;
+      break;
+    case 1:
+      if (is_class_catalog(current_catalog))
+      {
+        current_catalog = pcisubclass;
+        if ((len < 3) || (id[2] != ' ') || (sscanf(id, "%lx", &u[1]) != 1))
+          return -1;
+        skip = 3;
+      }
+      else
+      {
+        current_catalog = pcidevice;
+        if ((len < 5) || (id[4] != ' ') || (sscanf(id, "%lx", &u[1]) != 1))
+          return -1;
+        skip = 5;
+      }
+      u[2] = u[3] = -1;
+      break;
+    case 2:
+      if ((current_catalog != pcidevice) && (current_catalog != pcisubvendor)
+        && (current_catalog != pcisubclass) && (current_catalog != pciprogif))
+        return -1;
+      if ((current_catalog == pcisubclass) || (current_catalog == pciprogif))
+      {
+        current_catalog = pciprogif;
+        if ((len < 3) || (id[2] != ' ') || (sscanf(id, "%lx", &u[2]) != 1))
+          return -1;
+        u[3] = -1;
+        skip = 3;
+      }
+      else
+      {
+        current_catalog = pcisubvendor;
+        if ((len < 10) || (id[4] != ' ') || (id[9] != ' ') ||
+          (sscanf(id, "%lx%lx", &u[2], &u[3]) != 2))
+          return -1;
+        skip = 9;
+      }
+      break;
+    default:
+      return -1;
+  }
+
+  if (description)
+    *description = hw::strip(string(b + skip, e - b - skip));
+
+  return 1;
+}
+
+
+static const char *next_line(const char *p,
+const char *end)
+{
+  const char *eol = (const char *)memchr(p, '\n', end - p);
+
+  return eol ? eol : end;
+}
+
+
+/*
+ * indexes a pci.ids file: classes are few and parsed right away, vendors
+ * only get their blocks of lines recorded
+ */
+static void index_pcidb(const char *data,
+size_t size)
+{
+  const char *end = data + size;
+  const char *p = data;
+  const char *blockstart = data;
+  long owner = 0;                                 // before any vendor line
+  bool owned = true;                              // false in the classes
+  catalog current_catalog = pcivendor;
+  long u[4];
+
+  memset(u, 0, sizeof(u));
+
+  while (p < end)
+  {
+    const char *eol = next_line(p, end);
+    catalog previous_catalog = current_catalog;
+    long previous[4];
+    int r = 0;
+
+    memcpy(previous, u, sizeof(previous));
+    r = parse_pcidb_line(p, eol, current_catalog, u);
+
+    if (r < 0)
     {
-      case 0:
-        if ((line[0] == 'C') && (line.length() > 1) && (line[1] == ' '))
-        {
-          current_catalog = pciclass;
-          line = line.substr(2);                  // get rid of 'C '
-
-          if ((line.length() < 3) || (line[2] != ' '))
-            return false;
-          if (sscanf(line.c_str(), "%lx", &u[0]) != 1)
-            return false;
-          line = line.substr(3);
-          line = hw::strip(line);
-        }
-        else
-        {
-          current_catalog = pcivendor;
-
-          if ((line.length() < 5) || (line[4] != ' '))
-            return false;
-          if (sscanf(line.c_str(), "%lx", &u[0]) != 1)
-            return false;
-          line = line.substr(5);
-          line = hw::strip(line);
-        }
-        u[1] = u[2] = u[3] = -1;
-        break;
-      case 1:
-        if ((current_catalog == pciclass) || (current_catalog == pcisubclass)
-          || (current_catalog == pciprogif))
-        {
-          current_catalog = pcisubclass;
-
-          if ((line.length() < 3) || (line[2] != ' '))
-            return false;
-          if (sscanf(line.c_str(), "%lx", &u[1]) != 1)
-            return false;
-          line = line.substr(3);
-          line = hw::strip(line);
-        }
-        else
-        {
-          current_catalog = pcidevice;
-
-          if ((line.length() < 5) || (line[4] != ' '))
-            return false;
-          if (sscanf(line.c_str(), "%lx", &u[1]) != 1)
-            return false;
-          line = line.substr(5);
-          line = hw::strip(line);
-        }
-        u[2] = u[3] = -1;
-        break;
-      case 2:
-        if ((current_catalog != pcidevice) && (current_catalog != pcisubvendor)
-          && (current_catalog != pcisubclass)
-          && (current_catalog != pciprogif))
-          return false;
-        if ((current_catalog == pcisubclass) || (current_catalog == pciprogif))
-        {
-          current_catalog = pciprogif;
-          if ((line.length() < 3) || (line[2] != ' '))
-            return false;
-          if (sscanf(line.c_str(), "%lx", &u[2]) != 1)
-            return false;
-          u[3] = -1;
-          line = line.substr(2);
-          line = hw::strip(line);
-        }
-        else
-        {
-          current_catalog = pcisubvendor;
-          if ((line.length() < 10) || (line[4] != ' ') || (line[9] != ' '))
-            return false;
-          if (sscanf(line.c_str(), "%lx%lx", &u[2], &u[3]) != 2)
-            return false;
-          line = line.substr(9);
-          line = hw::strip(line);
-        }
-        break;
-      default:
-        return false;
+      end = p;                                    // parsing stops here
+      break;
     }
 
-//printf("%04x %04x %04x %04x %s\n", u[0], u[1], u[2], u[3], line.c_str());
-    if ((current_catalog == pciclass) ||
-      (current_catalog == pcisubclass) || (current_catalog == pciprogif))
+    if ((r > 0) && (current_catalog == pcivendor))
     {
+      if (owned && (p > blockstart))
+        pci_vendors[owner].blocks.push_back((pci_block){ blockstart, p });
+      owner = u[0];
+      owned = true;
+      blockstart = p;
+    }
+    else if ((r > 0) && is_class_catalog(current_catalog))
+    {
+      string line;
+
+      if (owned && (p > blockstart))
+        pci_vendors[owner].blocks.push_back((pci_block){ blockstart, p });
+      owned = false;
+
+      current_catalog = previous_catalog;         // again, with the description
+      memcpy(u, previous, sizeof(previous));
+      parse_pcidb_line(p, eol, current_catalog, u, &line);
       pci_classes.push_back(pci_entry(line, u[0], u[1], u[2], u[3]));
     }
-    else
+
+    p = (eol < end) ? eol + 1 : end;
+  }
+
+  if (owned && (end > blockstart))
+    pci_vendors[owner].blocks.push_back((pci_block){ blockstart, end });
+}
+
+
+// parses the blocks describing a vendor (with pcidb_lock held)
+static pci_catalog & vendor_devices(long vendor)
+{
+  static pci_catalog none;
+  map < long, pci_vendor >::iterator v = pci_vendors.find(vendor);
+
+  if (v == pci_vendors.end())
+    return none;
+
+  if (!v->second.parsed)
+  {
+    for (unsigned int i = 0; i < v->second.blocks.size(); i++)
     {
-      pci_devices.push_back(pci_entry(line, u[0], u[1], u[2], u[3]));
+      const pci_block & block = v->second.blocks[i];
+      catalog current_catalog = pcivendor;
+      long u[4];
+      string line;
+
+      memset(u, 0, sizeof(u));
+      for (const char *p = block.start; p < block.end;)
+      {
+        const char *eol = next_line(p, block.end);
+
+        if (parse_pcidb_line(p, eol, current_catalog, u, &line) > 0)
+          v->second.devices.push_back(pci_entry(line, u[0], u[1], u[2], u[3]));
+        p = (eol < block.end) ? eol + 1 : block.end;
+      }
     }
+    v->second.devices.sort();
+    v->second.parsed = true;
   }
-  return true;
+
+  return v->second.devices;
 }
 
 
-static bool load_pcidb()
+// pci.ids files in the order they are loaded (later ones can't override)
+static vector < string > pcidb_files()
 {
-  vector < string > lines;
   vector < string > filenames;
 
   splitlines(PCIID_PATH, filenames, ':');
-  for (int i = filenames.size() - 1; i >= 0; i--)
+  reverse(filenames.begin(), filenames.end());
+  return filenames;
+}
+
+
+static void index_pcidb_files(const vector < string > & filenames)
+{
+  for (unsigned int i = 0; i < filenames.size(); i++)
   {
-    lines.clear();
-    if (loadfile(filenames[i], lines) && (lines.size() > 0))
-      parse_pcidb(lines);
+    const char *data = NULL;
+    size_t size = 0;
+
+    if (mapfile(filenames[i], data, size) && (size > 0))
+      index_pcidb(data, size);
   }
 
-  return (pci_devices.size() > 0);
+  pci_classes.sort();
+}
+
+
+static bool load_pcidb()
+{
+  vector < string > filenames = pcidb_files();
+
+  if (iddb_usable(iddb_pci, filenames, true))
+    return (pcidb_compiled = true);
+
+  index_pcidb_files(filenames);
+
+  return (pci_vendors.size() > 0);
+}
+
+
+void export_pcidb(iddb_writer & db, const vector < string > & files)
+{
+  vector < string > filenames = files.empty() ? pcidb_files() : files;
+
+  index_pcidb_files(filenames);
+
+  for (unsigned int i = 0; i < filenames.size(); i++)
+    db.source(iddb_pci, filenames[i], true);
+  for (map < long, pci_vendor >::iterator v = pci_vendors.begin();
+    v != pci_vendors.end(); v++)
+  {
+    const pci_catalog & devices = vendor_devices(v->first);
+
+    for (unsigned int i = 0; i < devices.size(); i++)
+    {
+      const pci_entry & e = devices.entries[i];
+      db.add(iddb_pcidevices, e.description, e.ids[0], e.ids[1], e.ids[2], e.ids[3]);
+    }
+  }
+  for (unsigned int i = 0; i < pci_classes.size(); i++)
+  {
+    const pci_entry & e = pci_classes.entries[i];
+    db.add(iddb_pciclasses, e.description, e.ids[0], e.ids[1], e.ids[2], e.ids[3]);
+  }
+}
+
+
+// loaded once per process, then shared read-only by all scans
+void preload_pcidb()
+{
+  std::call_once(pcidb_once, load_pcidb);
 }
 
 
@@ -547,10 +770,12 @@ long pi = -1)
 {
   pci_entry result("");
 
-  if (find_best_match(pci_classes, result, c >> 8, c & 0xff, pi))
-    return result.description;
+  if (pcidb_compiled)
+    iddb_find(iddb_pciclasses, result.description, c >> 8, c & 0xff, pi, -1, true);
   else
-    return "";
+    find_best_match(pci_classes, result, c >> 8, c & 0xff, pi);
+
+  return result.description;
 }
 
 
@@ -561,10 +786,15 @@ long u4 = -1)
 {
   pci_entry result("");
 
-  if (find_best_match(pci_devices, result, u1, u2, u3, u4))
-    return result.description;
+  if (pcidb_compiled)
+    iddb_find(iddb_pcidevices, result.description, u1, u2, u3, u4, true);
   else
-    return "";
+  {
+    std::lock_guard < std::mutex > lock(pcidb_lock);
+    find_best_match(vendor_devices(u1), result, u1, u2, u3, u4);
+  }
+
+  return result.description;
 }
 
 
@@ -779,8 +1009,7 @@ static hwNode *scan_pci_dev(struct pci_dev &d, hwNode & n)
     core = n.getChild("core");
   }
 
-  if(!pcidb_loaded)
-    pcidb_loaded = load_pcidb();
+  preload_pcidb();
 
       u_int16_t tmp_vendor_id = get_conf_word(d, PCI_VENDOR_ID);
       u_int16_t tmp_device_id = get_conf_word(d, PCI_DEVICE_ID);
@@ -1053,10 +1282,9 @@ bool scan_pci_legacy(hwNode & n)
     core = n.getChild("core");
   }
 
-  if(!pcidb_loaded)
-    pcidb_loaded = load_pcidb();
+  preload_pcidb();
 
-  f = fopen(PROC_BUS_PCI "/devices", "r");
+  f = fopen_file(PROC_BUS_PCI "/devices");
   if (f)
   {
     char buf[512];
@@ -1106,7 +1334,7 @@ bool scan_pci_legacy(hwNode & n)
       snprintf(businfo, sizeof(businfo), "%02x:%02x.%x", d.bus, d.dev,
         d.func);
 
-      fd = open(devicepath.c_str(), O_RDONLY);
+      fd = open_file(devicepath, O_RDONLY);
       if (fd >= 0)
       {
         if(read(fd, d.config, sizeof(d.config)) != sizeof(d.config))
@@ -1140,14 +1368,18 @@ bool scan_pci(hwNode & n)
     core = n.getChild("core");
   }
 
-  pcidb_loaded = load_pcidb();
+  preload_pcidb();
 
   if(!pushd(SYS_BUS_PCI"/devices"))
     return false;
-  count = scandir(".", &devices, selectlink, alphasort);
+  count = scan_dir(".", &devices, selectlink);
   if(count>=0)
   {
+    const char *attributes[] = { "vendor", "device", "modalias", "irq" };
     int i = 0;
+
+    sysfs::prefetch(sysfs::entries_by_bus("pci"),
+      vector < string > (attributes, attributes + sizeof(attributes) / sizeof(attributes[0])));
     for(i=0; i<count; i++)
     if(matches(devices[i]->d_name, "^[[:xdigit:]]+:[[:xdigit:]]+:[[:xdigit:]]+\\.[[:xdigit:]]+$"))
     {
@@ -1155,7 +1387,7 @@ bool scan_pci(hwNode & n)
       sysfs::entry device_entry = sysfs::entry::byBus("pci", devices[i]->d_name);
       struct pci_dev d;
       memset(&d, 0, sizeof(d));
-      int fd = open(devicepath.c_str(), O_RDONLY);
+      int fd = open_file(devicepath, O_RDONLY);
       if (fd >= 0)
       {
         if(read(fd, d.config, 64) == 64)
@@ -1190,12 +1422,9 @@ bool scan_pci(hwNode & n)
             device->addCapability("rom", "extension ROM");
           }
 
-          if(exists(string(devices[i]->d_name)+"/irq"))
-          {
-            long irq = get_number(string(devices[i]->d_name)+"/irq", -1);
-            if(irq>=0)
-              device->addResource(hw::resource::irq(irq));
-          }
+          long irq = strtol(device_entry.string_attr("irq", "-1").c_str(), NULL, 10);
+          if(irq>=0)
+            device->addResource(hw::resource::irq(irq));
           device->claim();
         }
 
@@ -1203,7 +1432,7 @@ bool scan_pci(hwNode & n)
 
         if(exists(resourcename))
         {
-            FILE*resource = fopen(resourcename.c_str(), "r");
+            FILE*resource = fopen_file(resourcename);
 
             if(resource)
             {
@@ -2,7 +2,15 @@
 #define _PCI_H_
 
 #include "hw.h"
+#include <string>
+#include <vector>
+
+class iddb_writer;
 
 bool scan_pci(hwNode & n);
 bool scan_pci_legacy(hwNode & n);
+
+void preload_pcidb();
+// into the ID database: the given files, or those lshw would load if none
+void export_pcidb(iddb_writer &, const std::vector < std::string > & filenames = std::vector < std::string > ());
 #endif
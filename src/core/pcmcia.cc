@@ -37,7 +37,7 @@ bool scan_pcmcia(hwNode & n)
   if(!pushd(SYS_CLASS_PCMCIASOCKET))
     return false;
 
-  count = scandir(".", &sockets, NULL, alphasort);
+  count = scan_dir(".", &sockets);
   if(count>=0)
   {
     for(int i=0; i<count; i++)
@@ -10,6 +10,7 @@
 #include "pnp.h"
 #include "sysfs.h"
 #include "osutils.h"
+#include "iddb.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -17,6 +18,8 @@
 #include <ctype.h>
 #include <map>
 #include <iostream>
+#include <mutex>
+#include <algorithm>
 
 __ID("@(#) $Id$");
 
@@ -25,7 +28,8 @@ using namespace std;
 #define PNPVENDORS_PATH DATADIR"/pnp.ids:/usr/share/lshw/pnp.ids:/usr/share/hwdata/pnp.ids"
 #define PNPID_PATH DATADIR"/pnpid.txt:/usr/share/lshw/pnpid.txt:/usr/share/hwdata/pnpid.txt"
 
-static bool pnpdb_loaded = false;
+static std::once_flag pnpdb_once;
+static bool pnpdb_compiled = false;               // use ids.db instead
 
 static map < string, string > pnp_vendors;
 static map < string, string > pnp_ids;
@@ -73,37 +77,83 @@ static void parse_pnp_ids(const vector < string > & lines)
   }
 }
 
-static void load_pnpdb()
+// files in the order they are loaded (later ones override)
+static vector < string > pnpdb_files(const char *path)
 {
-  vector < string > lines;
   vector < string > filenames;
 
-  splitlines(PNPVENDORS_PATH, filenames, ':');
-  for (int i = filenames.size() - 1; i >= 0; i--)
+  splitlines(path, filenames, ':');
+  reverse(filenames.begin(), filenames.end());
+  return filenames;
+}
+
+static void parse_pnpdb_files(const vector < string > & vendorfiles,
+  const vector < string > & idfiles)
+{
+  vector < string > lines;
+
+  for (unsigned int i = 0; i < vendorfiles.size(); i++)
   {
     lines.clear();
-    if (loadfile(filenames[i], lines))
+    if (loadfile(vendorfiles[i], lines))
       parse_pnp_vendors(lines);
   }
 
-  filenames.clear();
-  splitlines(PNPID_PATH, filenames, ':');
-  for (int i = filenames.size() - 1; i >= 0; i--)
+  for (unsigned int i = 0; i < idfiles.size(); i++)
   {
     lines.clear();
-    if (loadfile(filenames[i], lines))
+    if (loadfile(idfiles[i], lines))
       parse_pnp_ids(lines);
   }
+}
+
+static void load_pnpdb()
+{
+  vector < string > vendorfiles = pnpdb_files(PNPVENDORS_PATH);
+  vector < string > idfiles = pnpdb_files(PNPID_PATH);
+  vector < string > filenames = vendorfiles;
 
-  pnpdb_loaded = true;
+  filenames.insert(filenames.end(), idfiles.begin(), idfiles.end());
+  if (iddb_usable(iddb_pnp, filenames, true))
+    pnpdb_compiled = true;
+  else
+    parse_pnpdb_files(vendorfiles, idfiles);
+}
+
+void export_pnpdb(iddb_writer & db, const vector < string > & vendors,
+  const vector < string > & ids)
+{
+  vector < string > vendorfiles = vendors.empty() ? pnpdb_files(PNPVENDORS_PATH) : vendors;
+  vector < string > idfiles = ids.empty() ? pnpdb_files(PNPID_PATH) : ids;
+
+  parse_pnpdb_files(vendorfiles, idfiles);
+
+  for (unsigned int i = 0; i < vendorfiles.size(); i++)
+    db.source(iddb_pnp, vendorfiles[i], true);
+  for (unsigned int i = 0; i < idfiles.size(); i++)
+    db.source(iddb_pnp, idfiles[i], true);
+
+  for (map < string, string >::const_iterator i = pnp_vendors.begin();
+      i != pnp_vendors.end(); ++i)
+    db.add(iddb_pnpvendors, i->second, iddb_key(i->first));
+  for (map < string, string >::const_iterator i = pnp_ids.begin();
+      i != pnp_ids.end(); ++i)
+    db.add(iddb_pnpids, i->second, iddb_key(i->first.substr(0, 3)),
+      iddb_key(i->first.substr(3)));
 }
 
 string pnp_vendorname(const string & id)
 {
-  if (!pnpdb_loaded)
-    load_pnpdb();
+  std::call_once(pnpdb_once, load_pnpdb);
 
   string vendorid = id.substr(0, 3);
+  string result = "";
+  if (pnpdb_compiled)
+  {
+    iddb_find(iddb_pnpvendors, result, iddb_key(vendorid));
+    return result;
+  }
+
   map < string, string >::const_iterator lookup = pnp_vendors.find(vendorid);
   if (lookup != pnp_vendors.end())
     return lookup->second;
@@ -112,8 +162,15 @@ string pnp_vendorname(const string & id)
 
 string pnp_description(const string & id)
 {
-  if (!pnpdb_loaded)
-    load_pnpdb();
+  std::call_once(pnpdb_once, load_pnpdb);
+
+  string result = "";
+  if (pnpdb_compiled)
+  {
+    iddb_find(iddb_pnpids, result, iddb_key(id.substr(0, 3)),
+      iddb_key(id.length() > 3 ? id.substr(3) : ""));
+    return result;
+  }
 
   map < string, string >::const_iterator lookup = pnp_ids.find(id);
   if (lookup != pnp_ids.end())
@@ -3,10 +3,18 @@
 
 #include "hw.h"
 #include <string>
+#include <vector>
+
+class iddb_writer;
 
 string pnp_vendorname(const string & id);
 
 hw::hwClass pnp_class(const string & pnpid);
 
 bool scan_pnp(hwNode &);
+
+// into the ID database: the given files, or those lshw would load if none
+void export_pnpdb(iddb_writer &,
+  const std::vector < std::string > & vendorfiles = std::vector < std::string > (),
+  const std::vector < std::string > & idfiles = std::vector < std::string > ());
 #endif
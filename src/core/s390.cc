@@ -113,7 +113,7 @@ static bool scan_ccw(hwNode & n)
     }
 
     device.claim();
-    n.addChild(device);
+    n.addChild(std::move(device));
   }
 
   return true;
@@ -3,6 +3,7 @@
 #include "cdrom.h"
 #include "disk.h"
 #include "osutils.h"
+#include "context.h"
 #include "heuristics.h"
 #include "sysfs.h"
 #include <glob.h>
@@ -203,7 +204,15 @@ static const char *devices[] =
   NULL
 };
 
-static map < string, string > sg_map;
+struct scsi_state
+{
+  map < string, string > sg_map;
+};
+
+static scsi_state & state()
+{
+  return context().state<scsi_state>();
+}
 
 static string scsi_handle(unsigned int host,
 int channel = -1,
@@ -561,7 +570,7 @@ static void scan_devices()
   {
     glob_t entries;
 
-    if(glob(devices[i], 0, NULL, &entries) == 0)
+    if(glob(rootpath(devices[i]).c_str(), 0, NULL, &entries) == 0)
     {
       for(j=0; j < entries.gl_pathc; j++)
       {
@@ -584,7 +593,7 @@ static void scan_devices()
               memset(&m_idlun, 0, sizeof(m_idlun));
               if (ioctl(fd, SCSI_IOCTL_GET_IDLUN, &m_idlun) >= 0)
               {
-                sg_map[string(entries.gl_pathv[j])] = scsi_handle(bus, (m_idlun.mux4 >> 16) & 0xff,
+                state().sg_map[string(entries.gl_pathv[j])] = scsi_handle(bus, (m_idlun.mux4 >> 16) & 0xff,
                   m_idlun.mux4 & 0xff,
                   (m_idlun.mux4 >> 8) & 0xff);
               }
@@ -601,9 +610,9 @@ static void scan_devices()
 
 static void find_logicalname(hwNode & n)
 {
-  map < string, string >::iterator i = sg_map.begin();
+  map < string, string >::iterator i = state().sg_map.begin();
 
-  for (i = sg_map.begin(); i != sg_map.end(); i++)
+  for (i = state().sg_map.begin(); i != state().sg_map.end(); i++)
   {
     if (i->second == n.getHandle())
     {
@@ -671,7 +680,7 @@ static void scan_sg(hwNode & n)
   size_t j;
   glob_t entries;
 
-  if(glob(SG_X, 0, NULL, &entries) == 0)
+  if(glob(rootpath(SG_X).c_str(), 0, NULL, &entries) == 0)
   {
     for(j=0; j < entries.gl_pathc; j++)
     {
@@ -809,7 +818,7 @@ static void scan_sg(hwNode & n)
   {
     parent->addCapability("emulated", "Emulated device");
   }
-  parent->addChild(device);
+  parent->addChild(std::move(device));
   }
 
   close(fd);
@@ -827,7 +836,7 @@ static bool scan_hosts(hwNode & node)
 
   if (!pushd("/proc/scsi"))
     return false;
-  n = scandir(".", &namelist, selectdir, alphasort);
+  n = scan_dir(".", &namelist, selectdir);
   popd();
   if ((n < 0) || !namelist)
     return false;
@@ -839,7 +848,7 @@ static bool scan_hosts(hwNode & node)
     int m = 0;
 
     pushd(namelist[i]->d_name);
-    m = scandir(".", &filelist, NULL, alphasort);
+    m = scan_dir(".", &filelist);
     popd();
 
     if (m >= 0)
@@ -14,6 +14,7 @@
 #include <cstring>
 
 #include "osutils.h"
+#include "context.h"
 
 __ID("@(#) $Id: smp.cc 1897 2007-10-02 13:29:47Z lyonel $");
 
@@ -86,24 +87,34 @@ typedef struct PROCENTRY {
 
 #define MAXPNSTR                                132
 
-static int pfd = -1; 
+struct smp_state
+{
+  smp_state(): pfd(-1) {}
+
+  int pfd;
+};
+
+static smp_state & state()
+{
+  return context().state<smp_state>();
+}
 
 static bool seekEntry(vm_offset_t addr)
 {
-  return(lseek(pfd, (off_t)addr, SEEK_SET) >= 0);
+  return(lseek(state().pfd, (off_t)addr, SEEK_SET) >= 0);
 }
 
 static bool readEntry(void* entry, int size)
 {
-  return (read(pfd, entry, size) == size);
+  return (read(state().pfd, entry, size) == size);
 }
 
 static int readType( void )
 {
     uint8_t      type;
 
-    if ( read( pfd, &type, sizeof( type ) ) == sizeof( type ) )
-      lseek( pfd, -sizeof( type ), SEEK_CUR );
+    if ( read( state().pfd, &type, sizeof( type ) ) == sizeof( type ) )
+      lseek( state().pfd, -sizeof( type ), SEEK_CUR );
 
     return (int)type;
 }
@@ -371,7 +382,7 @@ bool issmp(hwNode & n)
   vm_offset_t paddr;
   mpfps_t mpfps;
 
-  if((pfd = open("/dev/mem", O_RDONLY)) < 0)
+  if((state().pfd = open_file("/dev/mem", O_RDONLY)) < 0)
     return false;
 
   if (apic_probe(&paddr) <= 0)
@@ -391,7 +402,7 @@ bool issmp(hwNode & n)
   if(mpfps.pap)
     MPConfigTableHeader(n, mpfps.pap);
 
-  close(pfd);
+  close(state().pfd);
   return true;
 }
 
@@ -0,0 +1,489 @@
+/*
+ * snapshot.cc
+ *
+ * Compact, random-access dump of the hardware tree: a header followed by
+ * fixed-size node and property records, two sorted indexes (hw path and
+ * bus info) and a table of interned, NUL-terminated strings. All numbers
+ * are 32-bit in host byte order and all references are offsets in the file,
+ * so readers can use it straight from mmap().
+ *
+ * Nodes are stored breadth-first, which keeps the children of a node
+ * contiguous.
+ */
+
+#include "version.h"
+#include "snapshot.h"
+#include "osutils.h"
+#include "options.h"
+#include <map>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+
+__ID("@(#) $Id$");
+
+using namespace std;
+
+#define SNAPSHOT_MAGIC "LSHWSNAP"
+#define SNAPSHOT_VERSION 1
+#define NONE 0xffffffff
+
+struct snapshot_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t nodes, nodecount;
+  uint32_t props, propcount;
+  uint32_t paths, pathcount;
+  uint32_t businfos, businfocount;
+  uint32_t strings, stringsize;
+};
+
+struct snapshot_node
+{
+  uint32_t parent;
+  uint32_t firstchild, childcount;
+  uint32_t firstprop, propcount;
+};
+
+struct snapshot_prop
+{
+  uint32_t kind;
+  uint32_t key;
+  uint32_t value;
+};
+
+struct snapshot_entry
+{
+  uint32_t key;                                   // string offset
+  uint32_t node;
+};
+
+class snapshotwriter
+{
+  public:
+    snapshotwriter(): strings(1, '\0') {}
+
+    uint32_t intern(const string & s);
+    void add(uint32_t node, hwSnapshot::kind k, const string & key, const string & value);
+    void add(uint32_t node, const string & key, unsigned long long value);
+    void sort(vector < snapshot_entry > & index);
+
+    vector < snapshot_node > nodes;
+    vector < snapshot_prop > props;
+    vector < snapshot_entry > paths;
+    vector < snapshot_entry > businfos;
+    string strings;
+
+  private:
+    map < string, uint32_t > interned;
+};
+
+uint32_t snapshotwriter::intern(const string & s)
+{
+  if (s == "")
+    return 0;
+
+  map < string, uint32_t >::iterator i = interned.find(s);
+  if (i != interned.end())
+    return i->second;
+
+  uint32_t offset = strings.length();
+  strings += s;
+  strings += '\0';
+  interned[s] = offset;
+  return offset;
+}
+
+void snapshotwriter::add(uint32_t node, hwSnapshot::kind k, const string & key, const string & value)
+{
+  snapshot_prop p;
+
+  if (value == "" && k == hwSnapshot::field)
+    return;
+
+  p.kind = k;
+  p.key = intern(key);
+  p.value = intern(value);
+  props.push_back(p);
+  nodes[node].propcount++;
+}
+
+void snapshotwriter::add(uint32_t node, const string & key, unsigned long long value)
+{
+  char buffer[32];
+
+  if (value == 0)
+    return;
+
+  snprintf(buffer, sizeof(buffer), "%llu", value);
+  add(node, hwSnapshot::field, key, buffer);
+}
+
+struct entry_order
+{
+  const string & strings;
+
+  entry_order(const string & s): strings(s) {}
+  bool operator()(const snapshot_entry & a, const snapshot_entry & b) const
+  {
+    return strcmp(strings.c_str() + a.key, strings.c_str() + b.key) < 0;
+  }
+};
+
+void snapshotwriter::sort(vector < snapshot_entry > & index)
+{
+  stable_sort(index.begin(), index.end(), entry_order(strings));
+}
+
+static bool writeall(int fd, const void *data, size_t len)
+{
+  const char *p = (const char *)data;
+
+  while (len > 0)
+  {
+    ssize_t n = write(fd, p, len);
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool writesnapshot(hwNode & root, const string & filename)
+{
+  snapshotwriter w;
+  vector < hwNode * > queue;
+  vector < string > hwpaths;
+  snapshot_header header;
+
+  queue.push_back(&root);
+  hwpaths.push_back("");
+  for (uint32_t i = 0; i < queue.size(); i++)
+  {
+    hwNode & n = *queue[i];
+    snapshot_node record;
+    vector < string > keys;
+    string path = hwpaths[i];
+
+    record.parent = NONE;
+    record.firstchild = queue.size();
+    record.childcount = n.countChildren();
+    record.firstprop = w.props.size();
+    record.propcount = 0;
+    w.nodes.push_back(record);
+
+    for (unsigned int j = 0; j < n.countChildren(); j++)
+    {
+      hwNode *child = n.getChild(j);
+
+      queue.push_back(child);
+      hwpaths.push_back(child->getPhysId() != "" ? path + "/" + child->getPhysId() : "");
+    }
+
+    w.add(i, hwSnapshot::field, "id", n.getId());
+    w.add(i, hwSnapshot::field, "class", n.getClassName());
+    w.add(i, hwSnapshot::field, "path", path);
+    if (!n.enabled())
+      w.add(i, hwSnapshot::field, "disabled", "true");
+    if (n.claimed())
+      w.add(i, hwSnapshot::field, "claimed", "true");
+    w.add(i, hwSnapshot::field, "handle", n.getHandle());
+    w.add(i, hwSnapshot::field, "description", n.getDescription());
+    w.add(i, hwSnapshot::field, "product", n.getProduct());
+    w.add(i, hwSnapshot::field, "vendor", n.getVendor());
+    w.add(i, hwSnapshot::field, "subproduct", n.getSubProduct());
+    w.add(i, hwSnapshot::field, "subvendor", n.getSubVendor());
+    w.add(i, hwSnapshot::field, "physid", n.getPhysId());
+    w.add(i, hwSnapshot::field, "businfo", n.getBusInfo());
+    w.add(i, hwSnapshot::field, "dev", n.getDev());
+    w.add(i, hwSnapshot::field, "modalias", n.getModalias());
+    w.add(i, hwSnapshot::field, "version", n.getVersion());
+    w.add(i, hwSnapshot::field, "date", n.getDate());
+    if (n.getSerial() != "")
+      w.add(i, hwSnapshot::field, "serial", ::enabled("output:sanitize") ? REMOVED : n.getSerial());
+    w.add(i, hwSnapshot::field, "slot", n.getSlot());
+    w.add(i, "size", n.getSize());
+    w.add(i, "capacity", n.getCapacity());
+    w.add(i, "clock", n.getClock());
+    w.add(i, "width", n.getWidth());
+
+    keys = n.getLogicalNames();
+    for (unsigned int j = 0; j < keys.size(); j++)
+      w.add(i, hwSnapshot::logicalname, keys[j], "");
+
+    keys = n.getConfigKeys();
+    for (unsigned int j = 0; j < keys.size(); j++)
+      w.add(i, hwSnapshot::configuration, keys[j], n.getConfig(keys[j]));
+
+    keys = n.getCapabilitiesList();
+    for (unsigned int j = 0; j < keys.size(); j++)
+      w.add(i, hwSnapshot::capability, keys[j], n.getCapabilityDescription(keys[j]));
+
+    keys = n.getResources(":");
+    for (unsigned int j = 0; j < keys.size(); j++)
+    {
+      size_t colon = keys[j].find_first_of(':');
+      w.add(i, hwSnapshot::resource, keys[j].substr(0, colon), colon == string::npos ? "" : keys[j].substr(colon + 1));
+    }
+
+    keys = n.getHints();
+    for (unsigned int j = 0; j < keys.size(); j++)
+      w.add(i, hwSnapshot::hint, keys[j], n.getHint(keys[j]).asString());
+
+    if (path != "")
+    {
+      snapshot_entry e = { w.intern(path), i };
+      w.paths.push_back(e);
+    }
+    if (n.getBusInfo() != "")
+    {
+      snapshot_entry e = { w.intern(n.getBusInfo()), i };
+      w.businfos.push_back(e);
+    }
+  }
+
+  for (uint32_t i = 0; i < w.nodes.size(); i++)
+    for (uint32_t j = 0; j < w.nodes[i].childcount; j++)
+      w.nodes[w.nodes[i].firstchild + j].parent = i;
+
+  w.sort(w.paths);
+  w.sort(w.businfos);
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.nodes = sizeof(header);
+  header.nodecount = w.nodes.size();
+  header.props = header.nodes + header.nodecount * sizeof(snapshot_node);
+  header.propcount = w.props.size();
+  header.paths = header.props + header.propcount * sizeof(snapshot_prop);
+  header.pathcount = w.paths.size();
+  header.businfos = header.paths + header.pathcount * sizeof(snapshot_entry);
+  header.businfocount = w.businfos.size();
+  header.strings = header.businfos + header.businfocount * sizeof(snapshot_entry);
+  header.stringsize = w.strings.length();
+
+  int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+
+  bool result = writeall(fd, &header, sizeof(header)) &&
+    writeall(fd, w.nodes.data(), w.nodes.size() * sizeof(snapshot_node)) &&
+    writeall(fd, w.props.data(), w.props.size() * sizeof(snapshot_prop)) &&
+    writeall(fd, w.paths.data(), w.paths.size() * sizeof(snapshot_entry)) &&
+    writeall(fd, w.businfos.data(), w.businfos.size() * sizeof(snapshot_entry)) &&
+    writeall(fd, w.strings.data(), w.strings.length());
+
+  if (::close(fd) != 0)
+    result = false;
+
+  return result;
+}
+
+struct hwSnapshot_i
+{
+  const char *base;
+  size_t size;
+  const snapshot_header *header;
+  const snapshot_node *nodes;
+  const snapshot_prop *props;
+  const snapshot_entry *paths;
+  const snapshot_entry *businfos;
+  const char *strings;
+};
+
+hwSnapshot::hwSnapshot()
+{
+  This = NULL;
+}
+
+hwSnapshot::~hwSnapshot()
+{
+  close();
+}
+
+// checks that a table lies entirely inside the file
+static bool inside(size_t size, uint32_t offset, uint32_t count, size_t record)
+{
+  return (offset <= size) && ((size - offset) / record >= count);
+}
+
+bool hwSnapshot::open(const string & filename)
+{
+  struct stat buf;
+  const snapshot_header *h;
+
+  close();
+
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  if ((fstat(fd, &buf) != 0) || ((size_t)buf.st_size < sizeof(snapshot_header)))
+  {
+    ::close(fd);
+    return false;
+  }
+
+  void *base = mmap(NULL, buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (base == MAP_FAILED)
+    return false;
+
+  h = (const snapshot_header *)base;
+  if ((memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) != 0) ||
+    (h->version != SNAPSHOT_VERSION) ||
+    (h->nodecount == 0) ||
+    !inside(buf.st_size, h->nodes, h->nodecount, sizeof(snapshot_node)) ||
+    !inside(buf.st_size, h->props, h->propcount, sizeof(snapshot_prop)) ||
+    !inside(buf.st_size, h->paths, h->pathcount, sizeof(snapshot_entry)) ||
+    !inside(buf.st_size, h->businfos, h->businfocount, sizeof(snapshot_entry)) ||
+    !inside(buf.st_size, h->strings, h->stringsize, 1) ||
+    (h->stringsize == 0) ||
+    (((const char *)base)[h->strings + h->stringsize - 1] != '\0'))
+  {
+    munmap(base, buf.st_size);
+    return false;
+  }
+
+  This = new hwSnapshot_i;
+  This->base = (const char *)base;
+  This->size = buf.st_size;
+  This->header = h;
+  This->nodes = (const snapshot_node *)(This->base + h->nodes);
+  This->props = (const snapshot_prop *)(This->base + h->props);
+  This->paths = (const snapshot_entry *)(This->base + h->paths);
+  This->businfos = (const snapshot_entry *)(This->base + h->businfos);
+  This->strings = This->base + h->strings;
+
+  return true;
+}
+
+void hwSnapshot::close()
+{
+  if (!This)
+    return;
+
+  munmap((void *)This->base, This->size);
+  delete This;
+  This = NULL;
+}
+
+const char * hwSnapshot::str(unsigned int offset) const
+{
+  if (offset >= This->header->stringsize)
+    return "";
+  return This->strings + offset;
+}
+
+unsigned int hwSnapshot::countNodes() const
+{
+  if (!This)
+    return 0;
+
+  return This->header->nodecount;
+}
+
+long hwSnapshot::find(unsigned int index, unsigned int count, const string & key) const
+{
+  const snapshot_entry *entries = (const snapshot_entry *)(This->base + index);
+  unsigned int low = 0, high = count;
+
+  while (low < high)
+  {
+    unsigned int middle = low + (high - low) / 2;
+
+    if (strcmp(str(entries[middle].key), key.c_str()) < 0)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  if ((low < count) && (key == str(entries[low].key)) && (entries[low].node < countNodes()))
+    return entries[low].node;
+
+  return -1;
+}
+
+long hwSnapshot::findByPath(const string & hwpath) const
+{
+  if (!This)
+    return -1;
+
+  if ((hwpath == "") || (hwpath == "/"))        // the root is stored as ""
+    return 0;
+
+  return find(This->header->paths, This->header->pathcount, hwpath);
+}
+
+long hwSnapshot::findByBusInfo(const string & businfo) const
+{
+  if (!This)
+    return -1;
+
+  return find(This->header->businfos, This->header->businfocount, businfo);
+}
+
+long hwSnapshot::getParent(unsigned int node) const
+{
+  if (node >= countNodes() || This->nodes[node].parent == NONE)
+    return -1;
+
+  return This->nodes[node].parent;
+}
+
+unsigned int hwSnapshot::countChildren(unsigned int node) const
+{
+  if (node >= countNodes())
+    return 0;
+
+  return This->nodes[node].childcount;
+}
+
+long hwSnapshot::getChild(unsigned int node, unsigned int i) const
+{
+  if (i >= countChildren(node))
+    return -1;
+
+  uint32_t child = This->nodes[node].firstchild + i;
+  if (child >= countNodes())
+    return -1;
+
+  return child;
+}
+
+const char * hwSnapshot::get(unsigned int node, const char * key, kind k) const
+{
+  if (node >= countNodes())
+    return NULL;
+
+  const snapshot_node & n = This->nodes[node];
+  for (uint32_t i = n.firstprop; (i - n.firstprop < n.propcount) && (i < This->header->propcount); i++)
+    if ((This->props[i].kind == (uint32_t)k) && (strcmp(str(This->props[i].key), key) == 0))
+      return str(This->props[i].value);
+
+  return NULL;
+}
+
+vector < string > hwSnapshot::getKeys(unsigned int node, kind k) const
+{
+  vector < string > result;
+
+  if (node >= countNodes())
+    return result;
+
+  const snapshot_node & n = This->nodes[node];
+  for (uint32_t i = n.firstprop; (i - n.firstprop < n.propcount) && (i < This->header->propcount); i++)
+    if (This->props[i].kind == (uint32_t)k)
+      result.push_back(str(This->props[i].key));
+
+  return result;
+}
@@ -0,0 +1,60 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include "hw.h"
+
+#include <string>
+#include <vector>
+
+bool writesnapshot(hwNode &, const std::string & filename);
+
+/*
+ * read-only access to a snapshot written by writesnapshot(): the file is
+ * mmap()ed and nodes are looked up through its sorted indexes, nothing is
+ * parsed or copied in advance
+ *
+ * nodes are numbered from 0 (the root); every node carries a list of
+ * properties, each one a (kind, key, value) triple of strings
+ */
+class hwSnapshot
+{
+  public:
+    typedef enum
+    {
+      field,                                      // id, class, product, size...
+      configuration,
+      capability,
+      hint,
+      resource,
+      logicalname
+    } kind;
+
+    hwSnapshot();
+    ~hwSnapshot();
+
+    bool open(const std::string & filename);
+    void close();
+
+    unsigned int countNodes() const;
+    long findByPath(const std::string & hwpath) const;
+    long findByBusInfo(const std::string & businfo) const;
+
+    long getParent(unsigned int node) const;
+    unsigned int countChildren(unsigned int node) const;
+    long getChild(unsigned int node, unsigned int i) const;
+
+// NULL when the node doesn't have it
+    const char * get(unsigned int node, const char * key, kind k = field) const;
+    std::vector < std::string > getKeys(unsigned int node, kind k = field) const;
+
+  private:
+    hwSnapshot(const hwSnapshot &);
+    hwSnapshot & operator =(const hwSnapshot &);
+
+    long find(unsigned int index, unsigned int count, const std::string & key) const;
+    const char * str(unsigned int offset) const;
+
+    struct hwSnapshot_i *This;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include "version.h"
 #include "spd.h"
 #include "osutils.h"
+#include "context.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -23,17 +24,31 @@ __ID("@(#) $Id$");
 #define PROCSENSORS "/proc/sys/dev/sensors"
 #define EEPROMPREFIX "eeprom-"
 
-static unsigned char spd[SPD_MAXSIZE];
-static bool spd_page_loaded[SPD_MAXSIZE / SPD_BLKSIZE];
-static string current_eeprom = "";
-static unsigned int current_bank = 0;
+struct spd_state
+{
+  spd_state(): current_eeprom(""), current_bank(0)
+  {
+    memset(spd, 0, sizeof(spd));
+    memset(spd_page_loaded, 0, sizeof(spd_page_loaded));
+  }
+
+  unsigned char spd[SPD_MAXSIZE];
+  bool spd_page_loaded[SPD_MAXSIZE / SPD_BLKSIZE];
+  string current_eeprom;
+  unsigned int current_bank;
+};
+
+static spd_state & state()
+{
+  return context().state<spd_state>();
+}
 
 static unsigned char get_spd_byte(unsigned int offset)
 {
   if ((offset < 0) || (offset >= SPD_MAXSIZE))
     return 0;
 
-  if (!spd_page_loaded[offset / SPD_BLKSIZE])
+  if (!state().spd_page_loaded[offset / SPD_BLKSIZE])
   {
     char chunkname[10];
     string name = "";
@@ -42,23 +57,23 @@ static unsigned char get_spd_byte(unsigned int offset)
     snprintf(chunkname, sizeof(chunkname), "%02x",
       (offset / SPD_BLKSIZE) * SPD_BLKSIZE);
 
-    name = current_eeprom + "/" + string(chunkname);
+    name = state().current_eeprom + "/" + string(chunkname);
 
-    in = fopen(name.c_str(), "r");
+    in = fopen_file(name);
     if (in)
     {
       for (int i = 0; i < SPD_BLKSIZE; i++)
         if(fscanf(in, "%d",
-          (int *) &spd[i + (offset / SPD_BLKSIZE) * SPD_BLKSIZE]) < 1)
+          (int *) &state().spd[i + (offset / SPD_BLKSIZE) * SPD_BLKSIZE]) < 1)
             break;
       fclose(in);
-      spd_page_loaded[offset / SPD_BLKSIZE] = true;
+      state().spd_page_loaded[offset / SPD_BLKSIZE] = true;
     }
     else
-      spd_page_loaded[offset / SPD_BLKSIZE] = false;
+      state().spd_page_loaded[offset / SPD_BLKSIZE] = false;
   }
 
-  return spd[offset];
+  return state().spd[offset];
 }
 
 
@@ -69,7 +84,7 @@ static int selecteeprom(const struct dirent *d)
   if (d->d_name[0] == '.')
     return 0;
 
-  if (lstat(d->d_name, &buf) != 0)
+  if (stat_file(d->d_name, &buf, false) != 0)
     return 0;
 
   if (!S_ISDIR(buf.st_mode))
@@ -84,10 +99,10 @@ static hwNode *get_current_bank(hwNode & memory)
   char id[20];
   hwNode *result = NULL;
 
-  if ((current_bank == 0) && (result = memory.getChild("bank")))
+  if ((state().current_bank == 0) && (result = memory.getChild("bank")))
     return result;
 
-  snprintf(id, sizeof(id), "bank:%d", current_bank);
+  snprintf(id, sizeof(id), "bank:%d", state().current_bank);
   result = memory.getChild(id);
 
   if (!result)
@@ -107,9 +122,9 @@ string name)
   unsigned char density = 0;
   unsigned long long size = 0;
 
-  current_eeprom = string(PROCSENSORS) + "/" + name;
-  memset(spd, 0, sizeof(spd));
-  memset(spd_page_loaded, 0, sizeof(spd_page_loaded));
+  state().current_eeprom = string(PROCSENSORS) + "/" + name;
+  memset(state().spd, 0, sizeof(state().spd));
+  memset(state().spd_page_loaded, 0, sizeof(state().spd_page_loaded));
 
   for (int i = 0; i < 63; i++)
     checksum += get_spd_byte(i);
@@ -183,10 +198,10 @@ static bool scan_eeproms(hwNode & memory)
   struct dirent **namelist;
   int n;
 
-  current_bank = 0;
+  state().current_bank = 0;
 
   pushd(PROCSENSORS);
-  n = scandir(".", &namelist, selecteeprom, alphasort);
+  n = scan_dir(".", &namelist, selecteeprom);
   popd();
 
   if (n < 0)
@@ -195,7 +210,7 @@ static bool scan_eeproms(hwNode & memory)
   for (int i = 0; i < n; i++)
   {
     if (scan_eeprom(memory, namelist[i]->d_name))
-      current_bank++;
+      state().current_bank++;
     free(namelist[i]);
   }
   free(namelist);
@@ -208,7 +223,7 @@ bool scan_spd(hwNode & n)
 {
   hwNode *memory = n.getChild("core/memory");
 
-  current_bank = 0;
+  state().current_bank = 0;
 
   if (!memory)
   {
@@ -7,6 +7,7 @@
 #include "version.h"
 #include "sysfs.h"
 #include "osutils.h"
+#include "context.h"
 #include <limits.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -16,6 +17,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/mount.h>
+#include <map>
+#include <unordered_map>
+#include <mutex>
 
 
 __ID("@(#) $Id$");
@@ -29,13 +33,13 @@ struct sysfs::entry_i
 
 struct sysfs_t
 {
-  sysfs_t():path("/sys"),
+  sysfs_t():path(context().sysfs),
     temporary(false),
     has_sysfs(false)
   {
     has_sysfs = exists(path + "/class/.");
 
-    if (!has_sysfs)                               // sysfs doesn't seem to be mounted
+    if (!has_sysfs && context().sysroot.empty())  // sysfs doesn't seem to be mounted
 // try to mount it in a temporary directory
     {
       char buffer[50];
@@ -77,47 +81,198 @@ struct sysfs_t
   bool has_sysfs;
 };
 
-static sysfs_t fs;
+static sysfs_t & sysfs_root()
+{
+  return context().state<sysfs_t>();
+}
 
-static string sysfs_getbustype(const string & path)
+// attributes and resolved paths, read once per scan
+struct sysfs_cache
 {
-  struct dirent **namelist;
-  int i, n;
-  string bustype = "";
+  mutex lock;
+  map < string, pair < bool, string > > attributes;  // path -> (exists, value)
+  map < string, string > realpaths;
+};
+
+static sysfs_cache & cache()
+{
+  return context().state<sysfs_cache>();
+}
+
+static string resolve(const string & path)
+{
+  sysfs_cache & c = cache();
+
+  if ((path == "") || (path[0] != '/'))           // depends on pushd()
+    return realpath(path);
+
+  {
+    lock_guard < mutex > lock(c.lock);
+    map < string, string >::const_iterator i = c.realpaths.find(path);
+    if (i != c.realpaths.end())
+      return i->second;
+  }
+
+  string result = realpath(path);
+  lock_guard < mutex > lock(c.lock);
+  c.realpaths[path] = result;
+  return result;
+}
+
+static string attribute(const string & path, const string & def = "")
+{
+  sysfs_cache & c = cache();
+  pair < bool, string > value;
+
+  if ((path == "") || (path[0] != '/'))
+    return get_string(path, def);
+
+  {
+    lock_guard < mutex > lock(c.lock);
+    map < string, pair < bool, string > >::const_iterator i = c.attributes.find(path);
+    if (i != c.attributes.end())
+      return i->second.first ? i->second.second : def;
+  }
+
+  value.first = get_attribute(path, value.second);
+  lock_guard < mutex > lock(c.lock);
+  c.attributes[path] = value;
+  return value.first ? value.second : def;
+}
 
 /*
-  to determine to which kind of bus a device is connected:
-  - for each subdirectory of /sys/bus,
-  - look in ./devices/ for a link with the same basename as 'path'
-  - check if this link and 'path' point to the same inode
-  - if they do, the bus type is the name of the current directory
+ * the device graph: every device listed in /sys/bus/<bus>/devices and
+ * /sys/class/<class>, with its resolved path, read once per scan and shared
+ * by all the scanners
  */
-  pushd(fs.path + "/bus");
-  n = scandir(".", &namelist, selectdir, alphasort);
-  popd();
+typedef vector < pair < string, string > > sysfs_devices;  // (name, path)
 
-  if (n <= 0)
-    return "";
+struct sysfs_graph
+{
+  once_flag crawled;
+  map < string, sysfs_devices > buses;
+  map < string, sysfs_devices > classes;
+  map < string, string > bustypes;                // path -> bus
+  map < string, string > subsystems;              // path -> bus or class
+};
 
-  for (i = 0; i < n; i++)
-  {
-    string devname =
-      string(fs.path + "/bus/") + string(namelist[i]->d_name) +
-      "/devices/" + shortname(path);
+// where a link in dir points to: sysfs links always lead to real directories
+// so there is no need to realpath() (i.e. lstat() every component of) each one
+static string resolve_link(const string & dir, const string & name)
+{
+  string target = readlink(dir + "/" + name);
+  vector < string > components;
 
-    if (samefile(devname, path))
+  if ((target == "") || (target == dir + "/" + name) || (target[0] == '/'))
+    return realpath(dir + "/" + name);
+
+  splitlines(dir + "/" + target, components, '/');
+  vector < string > resolved;
+  for (unsigned int i = 0; i < components.size(); i++)
+  {
+    if ((components[i] == "") || (components[i] == "."))
+      continue;
+    if (components[i] == "..")
     {
-      bustype = string(namelist[i]->d_name);
-      break;
+      if (!resolved.empty())
+        resolved.pop_back();
     }
+    else
+      resolved.push_back(components[i]);
+  }
+
+  string result = "";
+  for (unsigned int i = 0; i < resolved.size(); i++)
+    result += "/" + resolved[i];
+  return (result == "") ? "/" : result;
+}
+
+static void crawl_links(const string & dir, sysfs_devices & devices)
+{
+  struct dirent **namelist;
+  string realdir = realpath(dir);
+  int count = scan_dir(dir, &namelist, selectlink);
+
+  if (count < 0)
+    return;
+
+  for (int i = 0; i < count; i++)
+  {
+    devices.push_back(make_pair(string(namelist[i]->d_name),
+      resolve_link(realdir, namelist[i]->d_name)));
     free(namelist[i]);
   }
+  free(namelist);
+}
 
-  for (int j = i; j < n; j++)
-    free(namelist[j]);
+static vector < string > subdirectories(const string & dir)
+{
+  struct dirent **namelist;
+  vector < string > result;
+  int count = scan_dir(dir, &namelist, selectdir);
+
+  if (count < 0)
+    return result;
+
+  for (int i = 0; i < count; i++)
+  {
+    result.push_back(namelist[i]->d_name);
+    free(namelist[i]);
+  }
   free(namelist);
 
-  return bustype;
+  return result;
+}
+
+static void crawl_sysfs(sysfs_graph & g)
+{
+  vector < string > buses = subdirectories(sysfs_root().path + "/bus");
+  vector < string > classes = subdirectories(sysfs_root().path + "/class");
+
+  for (unsigned int i = 0; i < buses.size(); i++)
+  {
+    sysfs_devices & devices = g.buses[buses[i]];
+
+    crawl_links(sysfs_root().path + "/bus/" + buses[i] + "/devices", devices);
+    for (unsigned int j = 0; j < devices.size(); j++)
+    {
+      g.bustypes.insert(make_pair(devices[j].second, buses[i]));
+      g.subsystems.insert(make_pair(devices[j].second, buses[i]));
+    }
+  }
+
+  for (unsigned int i = 0; i < classes.size(); i++)
+  {
+    sysfs_devices & devices = g.classes[classes[i]];
+
+    crawl_links(sysfs_root().path + "/class/" + classes[i], devices);
+    for (unsigned int j = 0; j < devices.size(); j++)
+      g.subsystems.insert(make_pair(devices[j].second, classes[i]));
+  }
+}
+
+static sysfs_graph & graph()
+{
+  sysfs_graph & g = context().state<sysfs_graph>();
+
+  call_once(g.crawled, crawl_sysfs, ref(g));
+  return g;
+}
+
+/*
+  to determine to which kind of bus a device is connected, look for it
+  in /sys/bus/<bus>/devices/
+ */
+static string sysfs_getbustype(const string & path)
+{
+  const sysfs_graph & g = graph();
+  map < string, string >::const_iterator i = g.bustypes.find(path);
+
+  if (i == g.bustypes.end())
+    i = g.bustypes.find(resolve(path));
+  if (i == g.bustypes.end())
+    return "";
+  return i->second;
 }
 
 
@@ -179,7 +334,7 @@ static string sysfstobusinfo(const string & path)
   {
     // just report businfo for the first device in the group
     // because the group doesn't really fit into lshw's tree model
-    string firstdev = realpath(path + "/cdev0");
+    string firstdev = resolve(path + "/cdev0");
     return sysfstobusinfo(firstdev);
   }
 
@@ -206,7 +361,7 @@ static string finddevice(const string & name, const string & root = "")
   if(exists(name))
     return root + "/" + name;
 
-  n = scandir(".", &namelist, selectdir, alphasort);
+  n = scan_dir(".", &namelist, selectdir);
 
   for (int i = 0; i < n; i++)
   {
@@ -226,17 +381,99 @@ static string finddevice(const string & name, const string & root = "")
 }
 
 
+/*
+ * every name found in /sys/devices and the directories it was found in (in
+ * the order finddevice() visits them), built the first time it's needed
+ */
+struct sysfs_index
+{
+  once_flag built;
+  vector < string > dirs;                         // relative to /sys/devices
+  unordered_map < string, vector < size_t > > names;
+};
+
+static void index_devices(sysfs_index & index, const string & path, const string & dir)
+{
+  struct dirent **namelist;
+  vector < string > subdirs;
+  size_t n = index.dirs.size();
+  int count = scan_dir(path + dir, &namelist, NULL);
+
+  if (count < 0)
+    return;
+
+  index.dirs.push_back(dir);
+  for (int i = 0; i < count; i++)
+  {
+    string name = namelist[i]->d_name;
+    struct stat buf;
+
+    if ((name != ".") && (name != ".."))
+      index.names[name].push_back(n);
+    if (name[0] != '.')                           // like selectdir()
+    {
+      if (namelist[i]->d_type == DT_DIR)
+        subdirs.push_back(name);
+      else
+      if ((namelist[i]->d_type == DT_UNKNOWN) &&
+        (stat_file(path + dir + "/" + name, &buf, false) == 0) &&
+        S_ISDIR(buf.st_mode))
+        subdirs.push_back(name);
+    }
+    free(namelist[i]);
+  }
+  free(namelist);
+
+  for (unsigned int i = 0; i < subdirs.size(); i++)
+    index_devices(index, path, dir + "/" + subdirs[i]);
+}
+
+static void build_index(sysfs_index & index)
+{
+  index_devices(index, sysfs_root().path + "/devices", "");
+}
+
 string sysfs_finddevice(const string & name)
 {
-  string devices = fs.path + string("/devices/");
+  string devices = sysfs_root().path + string("/devices");
   string result = "";
 
-  if(!pushd(devices))
+  if ((name == "") || (name == ".") || (name == "..") ||
+    (name.find('/') != string::npos))
+  {
+    if(!pushd(devices + "/"))
+      return "";
+    result = finddevice(name);
+    popd();
+
+    return result;
+  }
+
+  sysfs_index & index = context().state<sysfs_index>();
+  call_once(index.built, build_index, ref(index));
+
+  unordered_map < string, vector < size_t > >::const_iterator i = index.names.find(name);
+  if (i == index.names.end())
     return "";
-  result = finddevice(name);
-  popd();
 
-  return result;
+// like finddevice(): the last match, ignoring the ones below another match
+  string found = "";
+  bool matched = false;
+  for (unsigned int j = 0; j < i->second.size(); j++)
+  {
+    const string & dir = index.dirs[i->second[j]];
+
+    if (matched && (dir.compare(0, found.length() + 1, found + "/") == 0))
+      continue;
+    if (!exists(devices + dir + "/" + name))
+      continue;
+    if (dir == "")
+      return "/" + name;
+    found = dir;
+    matched = true;
+  }
+
+  return matched ? found + "/" + name : "";
 }
 
 entry entry::leaf() const
@@ -258,21 +495,21 @@ string entry::driver() const
 
 entry entry::byBus(string devbus, string devname)
 {
-  entry e(fs.path + "/bus/" + devbus + "/devices/" + devname);
+  entry e(sysfs_root().path + "/bus/" + devbus + "/devices/" + devname);
   return e;
 }
 
 
 entry entry::byClass(string devclass, string devname)
 {
-  entry e(fs.path + "/class/" + devclass + "/" + devname);
+  entry e(sysfs_root().path + "/class/" + devclass + "/" + devname);
   return e;
 }
 
 
 entry entry::byPath(string path)
 {
-  entry e(fs.path + "/devices" + path);
+  entry e(sysfs_root().path + "/devices" + path);
   return e;
 }
 
@@ -280,7 +517,21 @@ entry entry::byPath(string path)
 entry::entry(const string & devpath)
 {
   This = new entry_i;
-  This->devpath = realpath(devpath);
+  This->devpath = resolve(devpath);
+}
+
+
+entry entry::byResolvedPath(const string & devpath)
+{
+  entry e(devpath, true);
+  return e;
+}
+
+
+entry::entry(const string & devpath, bool resolved)
+{
+  This = new entry_i;
+  This->devpath = resolved ? devpath : resolve(devpath);
 }
 
 
@@ -320,7 +571,7 @@ string entry::name_in_class(const string & classname) const
     return result;
 
   struct dirent **namelist = NULL;
-  int count = scandir(".", &namelist, selectdir, alphasort);
+  int count = scan_dir(".", &namelist, selectdir);
   popd();
 
   if (count < 0)
@@ -357,7 +608,12 @@ string entry::classname() const
 
 string entry::subsystem() const
 {
-  return shortname(realpath(This->devpath+"/subsystem"));
+  const sysfs_graph & g = graph();
+  map < string, string >::const_iterator i = g.subsystems.find(This->devpath);
+
+  if (i != g.subsystems.end())
+    return i->second;
+  return shortname(resolve(This->devpath+"/subsystem"));
 }
 
 bool entry::isvirtual() const
@@ -367,7 +623,7 @@ bool entry::isvirtual() const
 
 string entry::string_attr(const string & name, const string & def) const
 {
-  return hw::strip(get_string(This->devpath + "/" + name, def));
+  return hw::strip(attribute(This->devpath + "/" + name, def));
 }
 
 
@@ -390,17 +646,17 @@ vector < string > entry::multiline_attr(const string & name) const
 
 string entry::modalias() const
 {
-  return get_string(This->devpath+"/modalias");
+  return attribute(This->devpath+"/modalias");
 }
 
 string entry::device() const
 {
-  return get_string(This->devpath+"/device");
+  return attribute(This->devpath+"/device");
 }
 
 string entry::vendor() const
 {
-  return get_string(This->devpath+"/vendor");
+  return attribute(This->devpath+"/vendor");
 }
 
 vector < entry > entry::devices() const
@@ -411,10 +667,10 @@ vector < entry > entry::devices() const
     return result;
 
   struct dirent **namelist;
-  int count = scandir(".", &namelist, selectdir, alphasort);
+  int count = scan_dir(".", &namelist, selectdir);
   for (int i = 0; i < count; i ++)
   {
-    entry e = sysfs::entry(This->devpath + "/" + string(namelist[i]->d_name));
+    entry e = sysfs::entry(This->devpath + "/" + string(namelist[i]->d_name), true);
     if(e.hassubdir("subsystem"))
 	    result.push_back(e);
     free(namelist[i]);
@@ -424,7 +680,7 @@ vector < entry > entry::devices() const
 
   if(pushd("block"))
   {
-    int count = scandir(".", &namelist, selectdir, alphasort);
+    int count = scan_dir(".", &namelist, selectdir);
     for (int i = 0; i < count; i ++)
     {
       entry e = sysfs::entry(This->devpath + "/block/" + string(namelist[i]->d_name));
@@ -440,48 +696,59 @@ vector < entry > entry::devices() const
   return result;
 }
 
-vector < entry > sysfs::entries_by_bus(const string & busname)
+static vector < entry > entries(const map < string, sysfs_devices > & m, const string & name)
 {
   vector < entry > result;
+  map < string, sysfs_devices >::const_iterator i = m.find(name);
 
-  if (!pushd(fs.path + "/bus/" + busname + "/devices"))
+  if (i == m.end())
     return result;
 
-  struct dirent **namelist;
-  int count;
-  count = scandir(".", &namelist, selectlink, alphasort);
-  for (int i = 0; i < count; i ++)
-  {
-    entry e = sysfs::entry::byBus(busname, namelist[i]->d_name);
-    result.push_back(e);
-    free(namelist[i]);
-  }
-  popd();
-  if (namelist)
-    free(namelist);
+  for (unsigned int j = 0; j < i->second.size(); j++)
+    result.push_back(entry::byResolvedPath(i->second[j].second));
   return result;
 }
 
+vector < entry > sysfs::entries_by_bus(const string & busname)
+{
+  return entries(graph().buses, busname);
+}
+
 vector < entry > sysfs::entries_by_class(const string & classname)
 {
-  vector < entry > result;
+  return entries(graph().classes, classname);
+}
 
-  if (!pushd(fs.path + "/class/" + classname))
-    return result;
+void sysfs::prefetch(const vector < entry > & entries, const vector < string > & names)
+{
+  sysfs_cache & c = cache();
+  vector < string > paths;
+  map < string, string > values;
 
-  struct dirent **namelist;
-  int count;
-  count = scandir(".", &namelist, selectlink, alphasort);
-  for (int i = 0; i < count; i ++)
   {
-    entry e = sysfs::entry::byClass(classname, namelist[i]->d_name);
-    result.push_back(e);
-    free(namelist[i]);
+    lock_guard < mutex > lock(c.lock);
+    for (unsigned int i = 0; i < entries.size(); i++)
+      for (unsigned int j = 0; j < names.size(); j++)
+      {
+        string path = entries[i].This->devpath + "/" + names[j];
+
+        if ((path[0] == '/') && (c.attributes.find(path) == c.attributes.end()))
+          paths.push_back(path);
+      }
+  }
+
+  get_attributes(paths, values);
+
+  lock_guard < mutex > lock(c.lock);
+  for (unsigned int i = 0; i < paths.size(); i++)
+  {
+    map < string, string >::const_iterator v = values.find(paths[i]);
+
+    if (v != values.end())
+      c.attributes[paths[i]] = make_pair(true, v->second);
+    else
+      c.attributes[paths[i]] = make_pair(false, string(""));
   }
-  popd();
-  if (namelist)
-    free(namelist);
-  return result;
 }
 
 bool scan_sysfs(hwNode & n)
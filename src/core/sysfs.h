@@ -16,6 +16,8 @@ namespace sysfs
       static entry byBus(string devbus, string devname);
       static entry byClass(string devclass, string devname);
       static entry byPath(string path);
+// devpath must be an absolute path without symlinks
+      static entry byResolvedPath(const string & devpath);
 
       entry & operator =(const entry &);
       entry(const entry &);
@@ -45,12 +47,16 @@ namespace sysfs
 
     private:
       entry(const string &);
+      entry(const string &, bool resolved);
 
   };
 
   vector < entry > entries_by_bus(const string & busname);
   vector < entry > entries_by_class(const string & classname);
 
+// reads the given attributes of all the entries at once
+  void prefetch(const vector < entry > & entries, const vector < string > & names);
+
 }                                                 // namespace sysfs
 
 
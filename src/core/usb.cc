@@ -13,9 +13,13 @@
 #include "osutils.h"
 #include "heuristics.h"
 #include "options.h"
+#include "iddb.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <map>
+#include <unordered_map>
+#include <mutex>
+#include <algorithm>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
@@ -26,6 +30,8 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <cstring>
+#include <ctype.h>
+#include <limits.h>
 
 #define PROCBUSUSBDEVICES "/proc/bus/usb/devices"
 #define SYSKERNELDEBUGUSBDEVICES "/sys/kernel/debug/usb/devices"
@@ -66,8 +72,25 @@
 #define USB_SC_WIRELESSRADIO    1
 #define USB_PROT_BLUETOOTH    1
 
-static map<u_int16_t,string> usbvendors;
-static map<u_int32_t,string> usbproducts;
+/*
+ * usb.ids files are mapped in memory; vendor names are read right away but
+ * the products of a vendor only when one of them is looked up
+ */
+struct usb_block
+{
+  u_int16_t vendor;
+  const char *start, *end;                        // lines following it
+};
+
+static unordered_map<u_int16_t,string> usbvendors;
+static unordered_map<u_int32_t,string> usbproducts;
+static vector<usb_block> usbblocks;               // in file order
+static unordered_map<u_int16_t,vector<unsigned> > vendorblocks;
+static unordered_map<u_int16_t,bool> vendorparsed;
+static bool usbdb_eager = false;                  // can't be parsed by vendor
+static bool usbdb_loaded = false;
+static bool usbdb_compiled = false;               // use ids.db instead
+static std::mutex usbdb_lock;
 
 #define PRODID(x, y) ((x << 16) + y)
 
@@ -277,79 +300,246 @@ static bool setUSBClass(hwNode & device, unsigned cls, unsigned sub, unsigned pr
 }
 
 
+/*
+ * reads the hexadecimal ID (at least 4 digits) starting a line like strtol()
+ * would; returns where the description starts or NULL if there's no ID
+ */
+static const char *usb_id(const char *p, const char *end, unsigned & id)
+{
+  long value = 0;
+  const char *q = p;
+
+  while ((q < end) && isxdigit((unsigned char)*q))
+  {
+    long digit = isdigit((unsigned char)*q) ? *q - '0' : tolower((unsigned char)*q) - 'a' + 10;
+
+    if (value <= (LONG_MAX - digit) / 16)
+      value = value * 16 + digit;
+    else
+      value = LONG_MAX;                           // strtol() saturates
+    q++;
+  }
+
+  if (q - p < 4)
+    return NULL;
+
+  id = value;
+  return q;
+}
+
+
+// end of the line starting at p, and where it stops being a C string
+static const char *usb_line(const char *p, const char *end, const char * & lineend)
+{
+  const char *eol = (const char *)memchr(p, '\n', end - p);
+  const char *nul = NULL;
+
+  if (!eol)
+    eol = end;
+  nul = (const char *)memchr(p, '\0', eol - p);
+  lineend = nul ? nul : eol;
+
+  return eol;
+}
+
+
+static void parse_usbblock(const usb_block & block)
+{
+  const char *p = block.start;
+
+  while (p < block.end)
+  {
+    const char *lineend = NULL;
+    const char *eol = usb_line(p, block.end, lineend);
+    const char *description = NULL;
+    unsigned t = 0;
+
+    if ((lineend > p) && (*p == '\t') &&         // product id entry
+      (description = usb_id(p + 1, lineend, t)))
+      usbproducts[((u_int32_t)block.vendor << 16) + t] = hw::strip(string(description, lineend - description));
+
+    p = (eol < block.end) ? eol + 1 : block.end;
+  }
+}
+
+
+// with usbdb_lock held
+static void parse_usbvendor(u_int16_t vendor)
+{
+  if (usbdb_eager || vendorparsed[vendor])
+    return;
+
+  const vector<unsigned> & blocks = vendorblocks[vendor];
+  for (unsigned i = 0; i < blocks.size(); i++)
+    parse_usbblock(usbblocks[blocks[i]]);
+  vendorparsed[vendor] = true;
+}
+
+
+static bool usb_vendorname(u_int16_t vendor, string & name)
+{
+  if(usbdb_compiled)
+    return iddb_find(iddb_usbvendors, name, vendor);
+
+  std::lock_guard < std::mutex > lock(usbdb_lock);
+  unordered_map<u_int16_t,string>::const_iterator i = usbvendors.find(vendor);
+  if(i==usbvendors.end()) return false;
+  name = i->second;
+  return true;
+}
+
+
+static bool usb_productname(u_int32_t prodid, string & name)
+{
+  if(usbdb_compiled)
+    return iddb_find(iddb_usbproducts, name, prodid >> 16, prodid & 0xffff);
+
+  std::lock_guard < std::mutex > lock(usbdb_lock);
+  parse_usbvendor(prodid >> 16);
+  unordered_map<u_int32_t,string>::const_iterator i = usbproducts.find(prodid);
+  if(i==usbproducts.end()) return false;
+  name = i->second;
+  return true;
+}
+
+
 static bool describeUSB(hwNode & device, unsigned vendor, unsigned prodid)
 {
-  if(usbvendors.find(vendor)==usbvendors.end()) return false;
+  string name = "";
 
-  device.setVendor(usbvendors[vendor]+(enabled("output:numeric")?" ["+tohex(vendor)+"]":""));
+  if(!usb_vendorname(vendor, name)) return false;
+
+  device.setVendor(name+(enabled("output:numeric")?" ["+tohex(vendor)+"]":""));
   device.addHint("usb.idVendor", vendor);
   device.addHint("usb.idProduct", prodid);
 
-  if(usbproducts.find(PRODID(vendor, prodid))!=usbproducts.end())
-    device.setProduct(usbproducts[PRODID(vendor, prodid)]+(enabled("output:numeric")?" ["+tohex(vendor)+":"+tohex(prodid)+"]":""));
+  if(usb_productname(PRODID(vendor, prodid), name))
+    device.setProduct(name+(enabled("output:numeric")?" ["+tohex(vendor)+":"+tohex(prodid)+"]":""));
 
   return true;
 }
 
 
+static void add_usbblock(u_int16_t vendor, const char *start, const char *end)
+{
+  usb_block block;
+
+  if (start >= end)
+    return;
+
+  block.vendor = vendor;
+  block.start = start;
+  block.end = end;
+  vendorblocks[vendor].push_back(usbblocks.size());
+  usbblocks.push_back(block);
+}
+
+
 static bool load_usbids(const string & name)
 {
-  FILE * usbids = NULL;
+  const char *data = NULL;
+  size_t size = 0;
   u_int16_t vendorid = 0;
 
-  usbids = fopen(name.c_str(), "r");
-  if(!usbids) return false;
+  if (!mapfile(name, data, size))
+    return false;
+
+  const char *end = data + size;
+  const char *p = data;
+  const char *blockstart = data;
 
-  while(!feof(usbids))
+  while (p < end)
   {
-    char * buffer = NULL;
-    size_t linelen;
+    const char *lineend = NULL;
+    const char *eol = usb_line(p, end, lineend);
+    const char *description = NULL;
     unsigned t = 0;
-    char *description = NULL;
 
-    if(getline(&buffer, &linelen, usbids)>0)
+    if (lineend > p)
     {
-      if(buffer[linelen-1]<' ')
-        buffer[linelen-1] = '\0';                 // chop \n
-      string line = string(buffer);
-      free(buffer);
-      buffer = NULL;
-
-      description = NULL;
-      t = 0;
-      if(line.length()>0)
+      if (*p == '\t')                             // product id entry
       {
-        if(line[0] == '\t')                       // product id entry
-        {
-          line.erase(0, 1);
-          if(matches(line, "^[[:xdigit:]][[:xdigit:]][[:xdigit:]][[:xdigit:]]"))
-            t = strtol(line.c_str(), &description, 16);
-          if(description && (description != line.c_str()))
-          {
-            usbproducts[PRODID(vendorid,t)] = hw::strip(description);
-          }
-        }
-        else                                      // vendor id entry
-        {
-          if(matches(line, "^[[:xdigit:]][[:xdigit:]][[:xdigit:]][[:xdigit:]]"))
-            t = strtol(line.c_str(), &description, 16);
-          if(description && (description != line.c_str()))
-          {
-            vendorid = t;
-            usbvendors[t] = hw::strip(description);
-          }
-        }
+        if (usb_id(p + 1, lineend, t) && (t > 0xffff))
+          usbdb_eager = true;                     // would spill over another vendor
+      }
+      else if ((description = usb_id(p, lineend, t)))   // vendor id entry
+      {
+        add_usbblock(vendorid, blockstart, p);
+        vendorid = t;
+        usbvendors[vendorid] = hw::strip(string(description, lineend - description));
+        blockstart = (eol < end) ? eol + 1 : end;
       }
     }
-    if(buffer != NULL) free(buffer);
-  }
 
-  fclose(usbids);
+    p = (eol < end) ? eol + 1 : end;
+  }
+  add_usbblock(vendorid, blockstart, end);
 
   return true;
 }
 
 
+// with usbdb_lock held
+static void parse_usbids()
+{
+  if (usbdb_eager)
+    for (unsigned i = 0; i < usbblocks.size(); i++)
+      parse_usbblock(usbblocks[i]);
+}
+
+
+// usb.ids files in the order they are loaded (later ones override)
+static vector < string > usbdb_files()
+{
+  vector < string > filenames;
+
+  splitlines(USBID_PATH, filenames, ':');
+  reverse(filenames.begin(), filenames.end());
+  return filenames;
+}
+
+
+void preload_usbdb()
+{
+  std::lock_guard < std::mutex > lock(usbdb_lock);
+
+  if (usbdb_loaded)
+    return;
+
+  if (!exists(SYSKERNELDEBUGUSBDEVICES) && !exists(PROCBUSUSBDEVICES))
+    return;
+
+  vector < string > filenames = usbdb_files();
+  if (iddb_usable(iddb_usb, filenames, true))
+    usbdb_compiled = true;
+  else
+  {
+    for (unsigned int i = 0; i < filenames.size(); i++)
+      load_usbids(filenames[i]);
+    parse_usbids();
+  }
+  usbdb_loaded = true;
+}
+
+
+void export_usbdb(iddb_writer & db, const vector < string > & files)
+{
+  vector < string > filenames = files.empty() ? usbdb_files() : files;
+
+  for (unsigned int i = 0; i < filenames.size(); i++)
+    if (load_usbids(filenames[i]))
+      db.source(iddb_usb, filenames[i], true);
+
+  usbdb_eager = true;                             // everything, in file order
+  parse_usbids();
+
+  for (unordered_map<u_int16_t,string>::const_iterator i = usbvendors.begin(); i != usbvendors.end(); i++)
+    db.add(iddb_usbvendors, i->second, i->first);
+  for (unordered_map<u_int32_t,string>::const_iterator i = usbproducts.begin(); i != usbproducts.end(); i++)
+    db.add(iddb_usbproducts, i->second, i->first >> 16, i->first & 0xffff);
+}
+
+
 bool scan_usb(hwNode & n)
 {
   hwNode device("device");
@@ -369,19 +559,13 @@ bool scan_usb(hwNode & n)
   if (!exists(SYSKERNELDEBUGUSBDEVICES) && !exists(PROCBUSUSBDEVICES))
     return false;
 
-  vector < string > filenames;
-  splitlines(USBID_PATH, filenames, ':');
-  for (int i = filenames.size() - 1; i >= 0; i--)
-  {
-    load_usbids(filenames[i]);
-  }
-  filenames.clear();
+  preload_usbdb();
 
   if (exists(SYSKERNELDEBUGUSBDEVICES))
-    usbdevices = fopen(SYSKERNELDEBUGUSBDEVICES, "r");
+    usbdevices = fopen_file(SYSKERNELDEBUGUSBDEVICES);
 
   if(!usbdevices && exists(PROCBUSUSBDEVICES))
-    usbdevices = fopen(PROCBUSUSBDEVICES, "r");
+    usbdevices = fopen_file(PROCBUSUSBDEVICES);
 
   if(!usbdevices)
     return false;
@@ -2,6 +2,14 @@
 #define _USB_H_
 
 #include "hw.h"
+#include <string>
+#include <vector>
+
+class iddb_writer;
 
 bool scan_usb(hwNode & n);
+
+void preload_usbdb();
+// into the ID database: the given files, or those lshw would load if none
+void export_usbdb(iddb_writer &, const std::vector < std::string > & filenames = std::vector < std::string > ());
 #endif
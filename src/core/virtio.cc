@@ -66,7 +66,7 @@ bool scan_virtio(hwNode & n)
       parent = n.getChild("core");
     if (!parent)
       parent = n.addChild(hwNode("core", hw::bus));
-    parent->addChild(device);
+    parent->addChild(std::move(device));
   }
 
   return true;
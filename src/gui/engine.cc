@@ -266,6 +266,8 @@ void refresh(GtkWidget *mainwindow)
   gtk_text_buffer_set_text(gtk_text_view_get_buffer(GTK_TEXT_VIEW(description)), "scanning...", -1);
 
   disable("output:sanitize");
+  disable("output:timing");
+  disable("output:trace");
   container = hwNode("container", hw::generic);
   status("Scanning...");
   scan_system(computer);
@@ -563,7 +565,7 @@ void save_as(GtkWidget *mainwindow)
         {
           std::ofstream out(filename);
           redirect_cout(out);
-          cout << computer->asXML();
+          computer->asXML(cout);
           redirect_cout(out, false);
         }
         else
@@ -587,7 +589,8 @@ void save_as(GtkWidget *mainwindow)
         {
           std::ofstream out(filename);
           redirect_cout(out);
-          cout << computer->asJSON() << endl;
+          computer->asJSON(cout);
+          cout << endl;
           redirect_cout(out, false);
         }
       }
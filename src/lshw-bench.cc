@@ -0,0 +1,511 @@
+/*
+ * lshw-bench.cc
+ *
+ * benchmark for lshw: builds a synthetic large host (PCI functions, NVMe
+ * namespaces, network interfaces, CPUs and block devices) as a -sysroot
+ * tree, then runs lshw against it once per output format and reports time,
+ * peak memory and the I/O of each scan stage (as counted by -timing)
+ *
+ */
+
+#include "version.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+
+__ID("@(#) $Id$");
+
+using namespace std;
+
+struct fixture
+{
+  unsigned int pci;                               // PCI functions, including:
+  unsigned int nvme;                              // NVMe namespaces (4 per controller)
+  unsigned int network;                           // network interfaces (1 per function)
+  unsigned int cpus;
+  unsigned int disks;                             // virtio block devices
+};
+
+struct run
+{
+  string format;
+  double wall, cpu;
+  long maxrss;                                    // kB
+  off_t output;                                   // bytes
+  long nodes;
+  double scan;                                    // wall time of the scan stages
+  long syscalls;                                  // opens, reads, stats, directories, links, chdirs
+  map < string, vector < double > > stages;       // wall, opens, reads, stats, dirs, links
+  vector < string > order;
+};
+
+static string root = "";
+
+static void fail(const string & what)
+{
+  perror(what.c_str());
+  exit(1);
+}
+
+static void makedirs(const string & path)
+{
+  size_t slash = path.rfind('/');
+  struct stat buf;
+
+  if (stat(path.c_str(), &buf) == 0)
+    return;
+  if ((slash != string::npos) && (slash > 0))
+    makedirs(path.substr(0, slash));
+  if ((mkdir(path.c_str(), 0755) != 0) && (errno != EEXIST))
+    fail(path);
+}
+
+static void writefile(const string & path, const string & contents)
+{
+  int fd = open((root + path).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if (fd < 0)
+    fail(root + path);
+  if (write(fd, contents.data(), contents.length()) != (ssize_t)contents.length())
+    fail(root + path);
+  close(fd);
+}
+
+static void makelink(const string & target, const string & path)
+{
+  if (symlink(target.c_str(), (root + path).c_str()) != 0)
+    fail(root + path);
+}
+
+static void makedir(const string & path)
+{
+  makedirs(root + path);
+}
+
+static string format(const char *fmt, ...)
+  __attribute__ ((format (printf, 1, 2)));
+
+static string format(const char *fmt, ...)
+{
+  char buffer[256];
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(buffer, sizeof(buffer), fmt, ap);
+  va_end(ap);
+
+  return string(buffer);
+}
+
+// a PCI function in /sys/devices/pci0000:BB/0000:BB:DD.F, returns its path
+static string pci_function(unsigned int n, unsigned short vendor, unsigned short device,
+unsigned int classcode, const string & driver)
+{
+  unsigned int bus = n / 256, dev = (n / 8) % 32, func = n % 8;
+  string name = format("0000:%02x:%02x.%x", bus, dev, func);
+  string path = format("/sys/devices/pci0000:%02x/", bus) + name;
+  unsigned char config[256];
+
+  memset(config, 0, sizeof(config));
+  config[0] = vendor & 0xff;
+  config[1] = vendor >> 8;
+  config[2] = device & 0xff;
+  config[3] = device >> 8;
+  config[8] = 1;                                  // revision
+  config[9] = classcode & 0xff;
+  config[10] = (classcode >> 8) & 0xff;
+  config[11] = (classcode >> 16) & 0xff;
+  config[0x2c] = config[0];                       // subsystem
+  config[0x2d] = config[1];
+  config[0x3c] = 16 + n % 64;                     // IRQ
+
+  makedir(path);
+  writefile(path + "/config", string((const char *)config, sizeof(config)));
+  writefile(path + "/vendor", format("0x%04x\n", vendor));
+  writefile(path + "/device", format("0x%04x\n", device));
+  writefile(path + "/irq", format("%d\n", config[0x3c]));
+  writefile(path + "/modalias", format("pci:v0000%04Xd0000%04Xsv0000%04Xsd0000%04Xbc%02Xsc%02Xi%02X\n",
+    vendor, device, vendor, device, config[11], config[10], config[9]));
+  writefile(path + "/resource", format("0x%016llx 0x%016llx 0x0000000000040200\n",
+    0xf0000000ULL + n * 0x10000ULL, 0xf0000000ULL + n * 0x10000ULL + 0xffff));
+  makedir("/sys/bus/pci/drivers/" + driver);
+  makelink("../../../bus/pci/drivers/" + driver, path + "/driver");
+  makelink(format("../../../devices/pci0000:%02x/", bus) + name, "/sys/bus/pci/devices/" + name);
+
+  return path;
+}
+
+static void build(const fixture & f)
+{
+  string netdev = "Inter-|   Receive                                                |  Transmit\n"
+    " face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed\n";
+  string cpuinfo = "";
+  unsigned int n = 0;
+
+  makedir("/sys/class/net");
+  makedir("/sys/class/nvme");
+  makedir("/sys/class/block");
+  makedir("/sys/bus/pci/devices");
+  makedir("/sys/bus/virtio/devices");
+  makedir("/sys/bus/virtio/drivers/virtio_blk");
+  makedir("/proc/net");
+
+  for (unsigned int i = 0; i < f.network && n < f.pci; i++, n++)
+  {
+    string path = pci_function(n, 0x8086, 0x10fb, 0x020000, "ixgbe");
+    string name = format("eth%u", i);
+
+    makedir(path + "/net/" + name);
+    writefile(path + "/net/" + name + "/address", format("02:00:00:%02x:%02x:%02x\n", i >> 16, (i >> 8) & 0xff, i & 0xff));
+    makelink("../../../" + path.substr(path.rfind('/') + 1), path + "/net/" + name + "/device");
+    makelink("../../../../../class/net", path + "/net/" + name + "/subsystem");
+    makelink("../.." + path.substr(4) + "/net/" + name, "/sys/class/net/" + name);
+    netdev += format("%6s: 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n", name.c_str());
+  }
+  writefile("/proc/net/dev", netdev);
+
+  for (unsigned int i = 0; i < (f.nvme + 3) / 4 && n < f.pci; i++, n++)
+  {
+    string path = pci_function(n, 0x144d, 0xa808, 0x010802, "nvme");
+    string name = format("nvme%u", i);
+    string ctrl = path + "/nvme/" + name;
+
+    makedir(ctrl);
+    writefile(ctrl + "/model", "Synthetic NVMe SSD\n");
+    writefile(ctrl + "/serial", format("S%08u\n", i));
+    writefile(ctrl + "/firmware_rev", "1.0\n");
+    writefile(ctrl + "/subsysnqn", format("nqn.2014.08.org.nvmexpress:%s\n", name.c_str()));
+    writefile(ctrl + "/state", "live\n");
+    makelink("../../../" + path.substr(path.rfind('/') + 1), ctrl + "/device");
+    makelink("../../../../../class/nvme", ctrl + "/subsystem");
+    makelink("../.." + ctrl.substr(4), "/sys/class/nvme/" + name);
+    for (unsigned int j = 1; (j <= 4) && ((i * 4 + j) <= f.nvme); j++)
+    {
+      string ns = ctrl + format("/%sn%u", name.c_str(), j);
+
+      makedir(ns);
+      writefile(ns + "/nsid", format("%u\n", j));
+      writefile(ns + "/wwid", format("eui.%016x\n", i * 4 + j));
+      makelink("../../../../../../class/block", ns + "/subsystem");
+    }
+  }
+
+  for (; n < f.pci; n++)
+    if (n % 2)
+      pci_function(n, 0x8086, 0xa102, 0x010601, "ahci");
+    else
+      pci_function(n, 0x8086, 0x2021, 0x088000, "ioatdma");
+
+  for (unsigned int i = 0; i < f.disks; i++)
+  {
+    string path = format("/sys/devices/platform/virtio-mmio.%u/virtio%u", i, i);
+    string disk = "vd";
+
+    for (unsigned int j = i; ; j = j / 26 - 1)
+    {
+      disk.insert(2, 1, 'a' + j % 26);
+      if (j < 26)
+        break;
+    }
+    makedir(path + "/block/" + disk);
+    makelink("../../../../bus/virtio/drivers/virtio_blk", path + "/driver");
+    makelink(format("../../../devices/platform/virtio-mmio.%u/virtio%u", i, i), format("/sys/bus/virtio/devices/virtio%u", i));
+  }
+
+  for (unsigned int i = 0; i < f.cpus; i++)
+    cpuinfo += format("processor\t: %u\n"
+      "vendor_id\t: GenuineIntel\n"
+      "cpu family\t: 6\n"
+      "model\t\t: 143\n"
+      "model name\t: Synthetic Xeon CPU @ 2.00GHz\n"
+      "stepping\t: 8\n"
+      "microcode\t: 0x2b000181\n"
+      "cpu MHz\t\t: 2000.000\n"
+      "cache size\t: 107520 KB\n"
+      "physical id\t: %u\n"
+      "siblings\t: 128\n"
+      "core id\t\t: %u\n"
+      "cpu cores\t: 64\n"
+      "apicid\t\t: %u\n"
+      "fpu\t\t: yes\n"
+      "fpu_exception\t: yes\n"
+      "cpuid level\t: 32\n"
+      "wp\t\t: yes\n"
+      "flags\t\t: fpu vme de pse tsc msr pae mce cx8 apic sep mtrr pge mca cmov pat pse36 clflush dts acpi mmx fxsr sse sse2 ss ht tm pbe syscall nx pdpe1gb rdtscp lm constant_tsc art arch_perfmon pebs bts rep_good nopl xtopology nonstop_tsc cpuid aperfmperf pni pclmulqdq dtes64 monitor ds_cpl vmx smx est tm2 ssse3 sdbg fma cx16 xtpr pdcm pcid dca sse4_1 sse4_2 x2apic movbe popcnt tsc_deadline_timer aes xsave avx f16c rdrand lahf_lm abm 3dnowprefetch\n"
+      "bogomips\t: 4000.00\n"
+      "clflush size\t: 64\n"
+      "cache_alignment\t: 64\n"
+      "address sizes\t: 46 bits physical, 57 bits virtual\n"
+      "power management:\n\n", i, i / 128, (i % 128) / 2, i);
+  writefile("/proc/cpuinfo", cpuinfo);
+}
+
+static double seconds()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// splits a line of the -timing table into the stage name (which may contain
+// spaces) and the numbers that follow it ("-" is read as -1)
+static bool timing_line(const string & line, string & name, vector < double > & values, size_t count)
+{
+  vector < string > words;
+  size_t i = 0;
+
+  while (i < line.length())
+  {
+    size_t j = line.find_first_of(" \n", i);
+
+    if (j == string::npos)
+      j = line.length();
+    if (j > i)
+      words.push_back(line.substr(i, j - i));
+    i = j + 1;
+  }
+
+  if (words.size() <= count)
+    return false;
+
+  name = "";
+  values.clear();
+  for (i = 0; i < words.size() - count; i++)
+    name += (i ? " " : "") + words[i];
+  for (; i < words.size(); i++)
+    values.push_back(words[i] == "-" ? -1 : strtod(words[i].c_str(), NULL));
+
+  return true;
+}
+
+static run benchmark(const string & lshw, const string & fmt, const string & tmpdir)
+{
+  run r;
+  string out = tmpdir + "/output", err = tmpdir + "/timing";
+  struct rusage usage;
+  struct stat buf;
+  int status = 0;
+  double start = seconds();
+
+  r.format = fmt.empty() ? "-text" : fmt;
+  r.nodes = 0;
+  r.scan = 0;
+  r.syscalls = 0;
+  pid_t pid = fork();
+  if (pid < 0)
+    fail("fork");
+  if (pid == 0)
+  {
+    int o = open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int e = open(err.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if ((o < 0) || (e < 0))
+      _exit(127);
+    dup2(o, 1);
+    dup2(e, 2);
+    if (fmt.empty())
+      execl(lshw.c_str(), lshw.c_str(), "-sysroot", root.c_str(), "-notime", "-quiet", "-timing", (char *)NULL);
+    else
+      execl(lshw.c_str(), lshw.c_str(), "-sysroot", root.c_str(), "-notime", "-quiet", "-timing", fmt.c_str(), (char *)NULL);
+    _exit(127);
+  }
+
+  if (wait4(pid, &status, 0, &usage) != pid)
+    fail("wait4");
+  r.wall = seconds() - start;
+  if (!WIFEXITED(status) || (WEXITSTATUS(status) == 127))
+  {
+    fprintf(stderr, "%s %s failed\n", lshw.c_str(), r.format.c_str());
+    exit(1);
+  }
+  r.cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+  r.maxrss = usage.ru_maxrss;
+  r.output = (stat(out.c_str(), &buf) == 0) ? buf.st_size : 0;
+
+  FILE *timing = fopen(err.c_str(), "r");
+  char line[1024];
+  bool table = false;
+
+  while (timing && fgets(line, sizeof(line), timing))
+  {
+    string s(line);
+    string name;
+    vector < double > values;
+
+    if (s.compare(0, 5, "stage") == 0)
+    {
+      table = true;
+      continue;
+    }
+    if (!table)
+      continue;
+    if (!timing_line(s, name, values, (s.compare(0, 5, "total") == 0) ? 9 : 12))
+      continue;
+// wall cpu opens reads bytes stats dirs links chdirs
+    if (name == "total")
+    {
+      r.scan = values[0];
+      r.syscalls = values[2] + values[3] + values[5] + values[6] + values[7] + values[8];
+      break;
+    }
+// thread start wall cpu nodes opens reads bytes stats dirs links chdirs
+    if (values[4] > 0)
+      r.nodes += values[4];
+    if (r.stages.find(name) == r.stages.end())
+      r.order.push_back(name);
+    r.stages[name].push_back(values[2]);
+    r.stages[name].push_back(values[5]);
+    r.stages[name].push_back(values[6]);
+    r.stages[name].push_back(values[8]);
+    r.stages[name].push_back(values[9]);
+    r.stages[name].push_back(values[10]);
+  }
+  if (timing)
+    fclose(timing);
+  unlink(out.c_str());
+  unlink(err.c_str());
+
+  return r;
+}
+
+static void usage(const char *progname)
+{
+  fprintf(stderr, "usage: %s [-keep] [-dir directory] [-scale factor] [-scaling] [lshw]\n", progname);
+  fprintf(stderr, "\t-keep           don't remove the synthetic tree\n");
+  fprintf(stderr, "\t-dir directory  build the synthetic tree there (must not exist)\n");
+  fprintf(stderr, "\t-scale factor   multiply the size of the host (10000 PCI functions, 2000 NVMe namespaces,\n");
+  fprintf(stderr, "\t                5000 network interfaces, 512 CPUs, 1000 block devices) by factor\n");
+  fprintf(stderr, "\t-scaling        also run at half size and compare each stage (catches quadratic behaviour)\n");
+  exit(1);
+}
+
+static vector < run > benchmarks(const string & lshw, const fixture & f, const string & dir, const string & name, bool keep)
+{
+  static const char *formats[] =
+  {
+    "", "-short", "-businfo", "-xml", "-json", "-html", "-cbor", NULL
+  };
+  vector < run > result;
+  double start = seconds();
+
+  root = dir + "/" + name;
+  if (mkdir(root.c_str(), 0755) != 0)
+    fail(root);
+  build(f);
+  fprintf(stderr, "%u PCI functions, %u NVMe namespaces, %u network interfaces, %u CPUs, %u block devices: built in %.2fs\n",
+    f.pci, f.nvme, f.network, f.cpus, f.disks, seconds() - start);
+
+  for (const char **fmt = formats; *fmt; fmt++)
+    result.push_back(benchmark(lshw, *fmt, dir));
+
+  if (!keep)
+  {
+    string cmd = "rm -rf '" + root + "'";
+    if (system(cmd.c_str()) != 0)
+      fprintf(stderr, "could not remove %s\n", root.c_str());
+  }
+
+  return result;
+}
+
+int main(int argc, char **argv)
+{
+  fixture f = { 10000, 2000, 5000, 512, 1000 };
+  fixture half;
+  string lshw = "./lshw";
+  string dir = "";
+  double scale = 1;
+  bool keep = false, scaling = false;
+  char tmpl[] = "/tmp/lshw-bench-XXXXXX";
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-keep") == 0)
+      keep = true;
+    else if (strcmp(argv[i], "-scaling") == 0)
+      scaling = true;
+    else if ((strcmp(argv[i], "-dir") == 0) && (i + 1 < argc))
+      dir = argv[++i];
+    else if ((strcmp(argv[i], "-scale") == 0) && (i + 1 < argc))
+      scale = strtod(argv[++i], NULL);
+    else if (argv[i][0] == '-')
+      usage(argv[0]);
+    else
+      lshw = argv[i];
+  }
+  if (scale <= 0)
+    usage(argv[0]);
+
+  f.pci *= scale;
+  f.nvme *= scale;
+  f.network *= scale;
+  f.cpus *= scale;
+  f.disks *= scale;
+  half.pci = f.pci / 2;
+  half.nvme = f.nvme / 2;
+  half.network = f.network / 2;
+  half.cpus = f.cpus / 2;
+  half.disks = f.disks / 2;
+
+  if (dir.empty())
+  {
+    if (!mkdtemp(tmpl))
+      fail(tmpl);
+    dir = tmpl;
+  }
+  else if (mkdir(dir.c_str(), 0755) != 0)
+    fail(dir);
+
+  vector < run > full = benchmarks(lshw, f, dir, "full", keep);
+  vector < run > small;
+  if (scaling)
+    small = benchmarks(lshw, half, dir, "half", keep);
+  if (!keep)
+    rmdir(dir.c_str());
+
+  printf("%-10s %9s %9s %9s %9s %10s %8s %9s %10s %12s\n", "format", "wall(s)", "CPU(s)", "scan(s)", "output(s)",
+    "nodes/s", "nodes", "syscalls", "maxRSS(kB)", "output(B)");
+  for (size_t i = 0; i < full.size(); i++)
+    printf("%-10s %9.3f %9.3f %9.3f %9.3f %10.0f %8ld %9ld %10ld %12lld\n", full[i].format.c_str(),
+      full[i].wall, full[i].cpu, full[i].scan, full[i].wall - full[i].scan,
+      full[i].wall > 0 ? full[i].nodes / full[i].wall : 0,
+      full[i].nodes, full[i].syscalls, full[i].maxrss, (long long)full[i].output);
+
+  printf("\n%-28s %9s %7s %7s %7s %7s %7s%s\n", "stage (-text run)", "wall(s)", "opens", "reads", "stats", "dirs", "links",
+    scaling ? "  x(half)" : "");
+  for (size_t i = 0; i < full[0].order.size(); i++)
+  {
+    const string & name = full[0].order[i];
+    const vector < double > & v = full[0].stages[name];
+
+    printf("%-28s %9.4f %7.0f %7.0f %7.0f %7.0f %7.0f", name.c_str(), v[0], v[1], v[2], v[3], v[4], v[5]);
+    if (scaling && (small[0].stages.find(name) != small[0].stages.end()))
+    {
+      double before = small[0].stages[name][0];
+
+      if (before > 0)
+        printf("  %7.2f%s", v[0] / before, ((v[0] > 0.01) && (v[0] / before > 3)) ? " superlinear!" : "");
+      else
+        printf("  %7s", "-");
+    }
+    printf("\n");
+  }
+
+  return 0;
+}
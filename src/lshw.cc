@@ -4,7 +4,9 @@
 #include "version.h"
 #include "options.h"
 #include "osutils.h"
+#include "context.h"
 #include "config.h"
+#include "snapshot.h"
 
 #include <unistd.h>
 #include <stdio.h>
@@ -29,6 +31,7 @@ void usage(const char *progname)
   fprintf(stderr, _("\t-html           output hardware tree as HTML\n"));
   fprintf(stderr, _("\t-xml            output hardware tree as XML\n"));
   fprintf(stderr, _("\t-json           output hardware tree as a JSON object\n"));
+  fprintf(stderr, _("\t-cbor           output hardware tree as binary CBOR\n"));
   fprintf(stderr, _("\t-short          output hardware paths\n"));
   fprintf(stderr, _("\t-businfo        output bus information\n"));
   if(getenv("DISPLAY") && exists(SBINDIR"/gtk-lshw"))
@@ -37,6 +40,7 @@ void usage(const char *progname)
 #ifdef SQLITE
   fprintf(stderr, _("\t-dump filename  display output and dump collected information into a file (SQLite database)\n"));
 #endif
+  fprintf(stderr, _("\t-snapshot filename  display output and save collected information into a snapshot file\n"));
   fprintf(stderr, _("\t-class CLASS    only show a certain class of hardware\n"));
   fprintf(stderr, _("\t-C CLASS        same as '-class CLASS'\n"));
   fprintf(stderr, _("\t-c CLASS        same as '-class CLASS'\n"));
@@ -48,6 +52,10 @@ void usage(const char *progname)
   fprintf(stderr, _("\t-sanitize       sanitize output (remove sensitive information like serial numbers, etc.)\n"));
   fprintf(stderr, _("\t-numeric        output numeric IDs (for PCI, USB, etc.)\n"));
   fprintf(stderr, _("\t-notime         exclude volatile attributes (timestamps) from output\n"));
+  fprintf(stderr, _("\t-timing         display how long each test took\n"));
+  fprintf(stderr, _("\t-trace filename save the timing of each test into a Chrome trace file\n"));
+  fprintf(stderr, _("\t-capture dir    copy the system files read by each test into a directory\n"));
+  fprintf(stderr, _("\t-sysroot dir    read the system files from a directory made by -capture\n"));
   fprintf(stderr, "\n");
 }
 
@@ -86,7 +94,9 @@ char **argv)
 
   disable("output:list");
   disable("output:json");
+  disable("output:cbor");
   disable("output:db");
+  disable("output:snapshot");
   disable("output:xml");
   disable("output:html");
   disable("output:hwpath");
@@ -95,6 +105,8 @@ char **argv)
   disable("output:quiet");
   disable("output:sanitize");
   disable("output:numeric");
+  disable("output:timing");
+  disable("output:trace");
   enable("output:time");
 
 // define some aliases for nodes classes
@@ -154,6 +166,12 @@ char **argv)
       validoption = true;
     }
 
+    if (strcmp(argv[1], "-cbor") == 0)
+    {
+      enable("output:cbor");
+      validoption = true;
+    }
+
     if (strcmp(argv[1], "-xml") == 0)
     {
       enable("output:xml");
@@ -197,6 +215,12 @@ char **argv)
       validoption = true;
     }
 
+    if (strcmp(argv[1], "-timing") == 0)
+    {
+      enable("output:timing");
+      validoption = true;
+    }
+
     if (strcmp(argv[1], "-notime") == 0)
     {
         disable("output:time");
@@ -242,16 +266,28 @@ char **argv)
     else
     {
       if (enabled("output:json"))
-        cout << computer.asJSON() << endl;
+      {
+        computer.asJSON(cout);
+        cout << endl;
+      }
+      else
+      if (enabled("output:cbor"))
+        computer.asCBOR(cout);
       else
       if (enabled("output:xml"))
-        cout << computer.asXML();
+        computer.asXML(cout);
       else
         print(computer, enabled("output:html"));
     }
 
     if(enabled("output:db"))
       computer.dump(getenv("OUTFILE"));
+
+    if(enabled("output:snapshot") && !writesnapshot(computer, getenv("SNAPSHOTFILE")))
+      fprintf(stderr, _("could not write snapshot to %s\n"), getenv("SNAPSHOTFILE"));
+
+    if (!context().capture.empty() && !capture_complete())
+      fprintf(stderr, _("could not copy everything to %s\n"), context().capture.c_str());
   }
 
   if (geteuid() != 0)
@@ -0,0 +1,626 @@
+/*
+ * parser-bench.cc
+ *
+ * micro-benchmark for the parsers that don't need any hardware: pci.ids,
+ * usb.ids, /proc/cpuinfo and SMBIOS tables are fed recorded (or generated)
+ * inputs and the time and memory allocations per line or per structure are
+ * reported, so that parser changes can be checked without the rest of a scan
+ *
+ */
+
+#include "version.h"
+#include "hw.h"
+#include "iddb.h"
+#include "pci.h"
+#include "usb.h"
+#include "cpuinfo.h"
+#include "dmi.h"
+#include "context.h"
+
+#include <string>
+#include <vector>
+#include <new>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+__ID("@(#) $Id$");
+
+using namespace std;
+
+static unsigned long allocations = 0;
+static unsigned long long allocated = 0;
+
+// every allocation made by the standard library goes through here
+void *operator new(size_t size)
+{
+  void *p = malloc(size ? size : 1);
+
+  if (!p)
+    throw bad_alloc();
+  __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&allocated, size, __ATOMIC_RELAXED);
+
+  return p;
+}
+
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+
+void operator delete(void *p, size_t) noexcept
+{
+  free(p);
+}
+
+
+void status(const char *)
+{
+}
+
+
+struct sample
+{
+  double ns;
+  unsigned long allocations;
+  unsigned long long bytes;
+};
+
+struct benchmark
+{
+  string parser;
+  string input;
+  string unit;
+  unsigned long items;
+  void (*run)(const string &);
+};
+
+static string tmpdir = "";
+
+static double nanoseconds()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static bool readfile(const string & path, string & contents)
+{
+  char buffer[65536];
+  ssize_t count = 0;
+  int fd = open(path.c_str(), O_RDONLY);
+
+  if (fd < 0)
+    return false;
+
+  contents = "";
+  while ((count = read(fd, buffer, sizeof(buffer))) > 0)
+    contents.append(buffer, count);
+  close(fd);
+
+  return count == 0;
+}
+
+static void writefile(const string & path, const string & contents)
+{
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if ((fd < 0) || (write(fd, contents.data(), contents.length()) != (ssize_t)contents.length()))
+  {
+    perror(path.c_str());
+    exit(1);
+  }
+  close(fd);
+}
+
+static unsigned long countlines(const string & contents)
+{
+  unsigned long lines = 0;
+
+  for (size_t i = 0; i < contents.length(); i++)
+    if (contents[i] == '\n')
+      lines++;
+
+  return lines;
+}
+
+static void run_pciids(const string & filename)
+{
+  iddb_writer db;
+
+  export_pcidb(db, vector < string > (1, filename));
+}
+
+static void run_usbids(const string & filename)
+{
+  iddb_writer db;
+
+  export_usbdb(db, vector < string > (1, filename));
+}
+
+static hwNode *computer = NULL;
+
+static void run_cpuinfo(const string &)
+{
+  scan_cpuinfo(*computer);
+}
+
+static void run_dmi(const string &)
+{
+  scan_dmi(*computer);
+}
+
+// runs a benchmark once, in a new process so that nothing is already loaded
+static bool measure(const benchmark & b, sample & result)
+{
+  int fds[2];
+  pid_t pid;
+  int status = 0;
+
+  if (pipe(fds) != 0)
+    return false;
+
+  pid = fork();
+  if (pid < 0)
+    return false;
+  if (pid == 0)
+  {
+    sample s;
+    double start;
+
+    close(fds[0]);
+    context().sysroot = tmpdir;
+    computer = new hwNode("computer", hw::system);
+
+    s.allocations = allocations;
+    s.bytes = allocated;
+    start = nanoseconds();
+    b.run(b.input);
+    s.ns = nanoseconds() - start;
+    s.allocations = allocations - s.allocations;
+    s.bytes = allocated - s.bytes;
+
+    if (write(fds[1], &s, sizeof(s)) != sizeof(s))
+      _exit(1);
+    _exit(0);
+  }
+
+  close(fds[1]);
+  bool ok = (read(fds[0], &result, sizeof(result)) == sizeof(result));
+  close(fds[0]);
+  waitpid(pid, &status, 0);
+
+  return ok && WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+// a cpuinfo entry as found on a recent x86 server
+static string cpuinfo(unsigned int cpus)
+{
+  string result = "";
+  char buffer[4096];
+
+  for (unsigned int i = 0; i < cpus; i++)
+  {
+    snprintf(buffer, sizeof(buffer), "processor\t: %u\n"
+      "vendor_id\t: GenuineIntel\n"
+      "cpu family\t: 6\n"
+      "model\t\t: 143\n"
+      "model name\t: Intel(R) Xeon(R) Platinum 8480+\n"
+      "stepping\t: 8\n"
+      "microcode\t: 0x2b000181\n"
+      "cpu MHz\t\t: 2000.000\n"
+      "cache size\t: 107520 KB\n"
+      "physical id\t: %u\n"
+      "siblings\t: 112\n"
+      "core id\t\t: %u\n"
+      "cpu cores\t: 56\n"
+      "apicid\t\t: %u\n"
+      "initial apicid\t: %u\n"
+      "fpu\t\t: yes\n"
+      "fpu_exception\t: yes\n"
+      "cpuid level\t: 32\n"
+      "wp\t\t: yes\n"
+      "flags\t\t: fpu vme de pse tsc msr pae mce cx8 apic sep mtrr pge mca cmov pat pse36 clflush dts acpi mmx fxsr sse sse2 ss ht tm pbe syscall nx pdpe1gb rdtscp lm constant_tsc art arch_perfmon pebs bts rep_good nopl xtopology nonstop_tsc cpuid aperfmperf tsc_known_freq pni pclmulqdq dtes64 monitor ds_cpl vmx smx est tm2 ssse3 sdbg fma cx16 xtpr pdcm pcid dca sse4_1 sse4_2 x2apic movbe popcnt tsc_deadline_timer aes xsave avx f16c rdrand lahf_lm abm 3dnowprefetch cpuid_fault epb cat_l3 cat_l2 cdp_l3 invpcid_single cdp_l2 ssbd mba ibrs ibpb stibp ibrs_enhanced tpr_shadow flexpriority ept vpid ept_ad fsgsbase tsc_adjust bmi1 avx2 smep bmi2 erms invpcid cqm rdt_a avx512f avx512dq rdseed adx smap avx512ifma clflushopt clwb intel_pt avx512cd sha_ni avx512bw avx512vl xsaveopt xsavec xgetbv1 xsaves cqm_llc cqm_occup_llc cqm_mbm_total cqm_mbm_local split_lock_detect avx_vnni avx512_bf16 wbnoinvd dtherm ida arat pln pts hfi vnmi avx512vbmi umip pku ospke waitpkg avx512_vbmi2 gfni vaes vpclmulqdq avx512_vnni avx512_bitalg tme avx512_vpopcntdq la57 rdpid bus_lock_detect cldemote movdiri movdir64b enqcmd fsrm md_clear serialize tsxldtrk pconfig arch_lbr ibt amx_bf16 avx512_fp16 amx_tile amx_int8 flush_l1d arch_capabilities\n"
+      "vmx flags\t: vnmi preemption_timer posted_intr invvpid ept_x_only ept_ad ept_1gb flexpriority apicv tsc_offset vtpr mtf vapic ept vpid unrestricted_guest vapic_reg vid ple shadow_vmcs pml ept_mode_based_exec tsc_scaling usr_wait_pause notify_vm_exiting ipi_virt\n"
+      "bugs\t\t: spectre_v1 spectre_v2 spec_store_bypass swapgs eibrs_pbrsb\n"
+      "bogomips\t: 4000.00\n"
+      "clflush size\t: 64\n"
+      "cache_alignment\t: 64\n"
+      "address sizes\t: 46 bits physical, 57 bits virtual\n"
+      "power management:\n\n",
+      i, i / 112, (i % 112) / 2, i, i);
+    result += buffer;
+  }
+
+  return result;
+}
+
+// an SMBIOS structure: the formatted area (after the header) and its strings
+static string structure(unsigned char type, unsigned short handle,
+const vector < unsigned char > & formatted, const vector < string > & strings)
+{
+  string result;
+
+  result += (char)type;
+  result += (char)(4 + formatted.size());
+  result += (char)(handle & 0xff);
+  result += (char)(handle >> 8);
+  result.append((const char *)formatted.data(), formatted.size());
+  for (unsigned int i = 0; i < strings.size(); i++)
+  {
+    result += strings[i];
+    result += '\0';
+  }
+  if (strings.empty())
+    result += '\0';
+  result += '\0';
+
+  return result;
+}
+
+static void put16(vector < unsigned char > & v, size_t offset, unsigned int value)
+{
+  v[offset - 4] = value & 0xff;
+  v[offset - 3] = (value >> 8) & 0xff;
+}
+
+static void put32(vector < unsigned char > & v, size_t offset, unsigned long value)
+{
+  put16(v, offset, value & 0xffff);
+  put16(v, offset + 2, value >> 16);
+}
+
+/*
+ * a SMBIOS 3 table like the ones of a large server: BIOS, system, board and
+ * chassis, 8 processors with 3 caches each, 64 slots and memory devices
+ */
+static string smbios(unsigned int dimms, unsigned long & structures)
+{
+  string result = "";
+  unsigned short handle = 0;
+  char buffer[64];
+
+  {
+    vector < unsigned char > f(0x1a - 4, 0);
+    f[0x04 - 4] = 1; f[0x05 - 4] = 2; f[0x08 - 4] = 3;
+    put16(f, 0x06, 0xf000);
+    f[0x09 - 4] = 0xff;
+    put32(f, 0x0a, 0x0b9a9880);
+    f[0x12 - 4] = 0x03; f[0x13 - 4] = 0x0d;
+    put16(f, 0x18, 64);
+    result += structure(0, handle++, f, { "Synthetic BIOS Inc.", "1.2.3", "01/01/2024" });
+  }
+  {
+    vector < unsigned char > f(0x1b - 4, 0);
+    f[0x04 - 4] = 1; f[0x05 - 4] = 2; f[0x06 - 4] = 3; f[0x07 - 4] = 4;
+    for (int i = 0; i < 16; i++)
+      f[0x08 - 4 + i] = 0x10 + i;
+    f[0x18 - 4] = 6; f[0x19 - 4] = 5; f[0x1a - 4] = 6;
+    result += structure(1, handle++, f, { "Synthetic", "Server 9000", "1.0", "SN0001", "SKU1", "Servers" });
+  }
+  {
+    vector < unsigned char > f(0x0f - 4, 0);
+    f[0x04 - 4] = 1; f[0x05 - 4] = 2; f[0x06 - 4] = 3; f[0x07 - 4] = 4; f[0x08 - 4] = 5;
+    f[0x09 - 4] = 0x09; f[0x0a - 4] = 6;
+    put16(f, 0x0b, 3);
+    f[0x0d - 4] = 0x0a;
+    result += structure(2, handle++, f, { "Synthetic", "Board 9000", "1.0", "BSN0001", "Asset", "Center" });
+  }
+  {
+    vector < unsigned char > f(0x15 - 4, 0);
+    f[0x04 - 4] = 1; f[0x05 - 4] = 0x17; f[0x06 - 4] = 2; f[0x07 - 4] = 3; f[0x08 - 4] = 4;
+    f[0x09 - 4] = 3; f[0x0a - 4] = 3; f[0x0b - 4] = 3; f[0x0c - 4] = 3;
+    f[0x11 - 4] = 2;
+    result += structure(3, handle++, f, { "Synthetic", "1.0", "CSN0001", "Asset" });
+  }
+  structures = 4;
+
+  for (unsigned int cpu = 0; cpu < 8; cpu++)
+  {
+    static const unsigned int cachesize[] = { 80, 2048, 0x8000 | 1680 };   // 80KB, 2MB, 105MB
+    unsigned short cache = handle;
+
+    for (unsigned int level = 1; level <= 3; level++)
+    {
+      vector < unsigned char > f(0x1b - 4, 0);
+
+      snprintf(buffer, sizeof(buffer), "L%u-Cache", level);
+      f[0x04 - 4] = 1;
+      put16(f, 0x05, 0x0180 | (level - 1) | ((level == 1) ? 0 : 0x08));
+      put16(f, 0x07, cachesize[level - 1]);
+      put16(f, 0x09, cachesize[level - 1]);
+      put16(f, 0x0b, 0x20);
+      put16(f, 0x0d, 0x20);
+      f[0x10 - 4] = 5; f[0x11 - 4] = 5; f[0x12 - 4] = 8;
+      result += structure(7, handle++, f, { buffer });
+      structures++;
+    }
+
+    vector < unsigned char > f(0x30 - 4, 0);
+    snprintf(buffer, sizeof(buffer), "CPU%u", cpu);
+    f[0x04 - 4] = 1; f[0x05 - 4] = 3; f[0x06 - 4] = 0xfe; f[0x07 - 4] = 2;
+    put32(f, 0x08, 0x000806f8);
+    put32(f, 0x0c, 0xbfebfbff);
+    f[0x10 - 4] = 3; f[0x11 - 4] = 0x90;
+    put16(f, 0x12, 100);
+    put16(f, 0x14, 4000);
+    put16(f, 0x16, 2000);
+    f[0x18 - 4] = 0x41; f[0x19 - 4] = 0x3e;
+    put16(f, 0x1a, cache);
+    put16(f, 0x1c, cache + 1);
+    put16(f, 0x1e, cache + 2);
+    f[0x20 - 4] = 4; f[0x21 - 4] = 5;
+    f[0x23 - 4] = 56; f[0x24 - 4] = 56; f[0x25 - 4] = 112;
+    put16(f, 0x26, 0xfc);
+    put16(f, 0x28, 0xb3);
+    put16(f, 0x2a, 56);
+    put16(f, 0x2c, 56);
+    put16(f, 0x2e, 112);
+    result += structure(4, handle++, f, { buffer, "Intel(R) Corporation", "Intel(R) Xeon(R) Platinum 8480+", "SN", "Asset" });
+    structures++;
+  }
+
+  for (unsigned int slot = 0; slot < 64; slot++)
+  {
+    vector < unsigned char > f(0x11 - 4, 0);
+
+    snprintf(buffer, sizeof(buffer), "PCIe Slot %u", slot);
+    f[0x04 - 4] = 1; f[0x05 - 4] = 0xb6; f[0x06 - 4] = 0x0d; f[0x07 - 4] = 4; f[0x08 - 4] = 4;
+    put16(f, 0x09, slot);
+    f[0x0b - 4] = 4; f[0x0c - 4] = 3;
+    f[0x0f - 4] = slot; f[0x10 - 4] = 0;
+    result += structure(9, handle++, f, { buffer });
+    structures++;
+  }
+
+  unsigned short array = handle;
+  {
+    vector < unsigned char > f(0x17 - 4, 0);
+    f[0x04 - 4] = 3; f[0x05 - 4] = 3; f[0x06 - 4] = 6;
+    put32(f, 0x07, 0x80000000);
+    put16(f, 0x0b, 0xfffe);
+    put16(f, 0x0d, dimms);
+    put32(f, 0x0f, (unsigned long)dimms * 16 * 1024 * 1024);
+    result += structure(16, handle++, f, { });
+    structures++;
+  }
+
+  for (unsigned int dimm = 0; dimm < dimms; dimm++)
+  {
+    vector < unsigned char > f(0x28 - 4, 0);
+    string locator, bank, serial;
+
+    snprintf(buffer, sizeof(buffer), "DIMM_%c%u", 'A' + dimm % 16, dimm / 16);
+    locator = buffer;
+    snprintf(buffer, sizeof(buffer), "NODE %u", dimm / 16);
+    bank = buffer;
+    snprintf(buffer, sizeof(buffer), "%08X", dimm);
+    serial = buffer;
+    put16(f, 0x04, array);
+    put16(f, 0x06, 0xfffe);
+    put16(f, 0x08, 72);
+    put16(f, 0x0a, 64);
+    put16(f, 0x0c, 16384);
+    f[0x0e - 4] = 9; f[0x10 - 4] = 1; f[0x11 - 4] = 2; f[0x12 - 4] = 0x22;
+    put16(f, 0x13, 0x80);
+    put16(f, 0x15, 4800);
+    f[0x17 - 4] = 3; f[0x18 - 4] = 4; f[0x19 - 4] = 5; f[0x1a - 4] = 6; f[0x1b - 4] = 2;
+    put16(f, 0x20, 4800);
+    put16(f, 0x22, 1100);
+    put16(f, 0x24, 1100);
+    put16(f, 0x26, 1100);
+    result += structure(17, handle++, f, { locator, bank, "Samsung", serial, "Asset", "M321R2GA3BB6-CQKET" });
+    structures++;
+  }
+
+  {
+    vector < unsigned char > f(0x0f - 4, 0);
+    put32(f, 0x04, 0);
+    put32(f, 0x08, (unsigned long)dimms * 16 * 1024 * 1024 - 1);
+    put16(f, 0x0c, array);
+    f[0x0e - 4] = (dimms > 255) ? 255 : dimms;
+    result += structure(19, handle++, f, { });
+    structures++;
+  }
+
+  result += structure(127, handle++, vector < unsigned char > (), { });
+  structures++;
+
+  return result;
+}
+
+// number of structures in a table (stops at the end-of-table one)
+static unsigned long countstructures(const string & table)
+{
+  unsigned long count = 0;
+  size_t p = 0;
+
+  while (p + 4 <= table.length())
+  {
+    unsigned char type = table[p];
+    size_t next = p + (unsigned char)table[p + 1];
+
+    while ((next + 1 < table.length()) && (table[next] || table[next + 1]))
+      next++;
+    count++;
+    p = next + 2;
+    if (type == 127)
+      break;
+  }
+
+  return count;
+}
+
+static string entrypoint(const string & table)
+{
+  unsigned char ep[24];
+  unsigned char sum = 0;
+
+  memset(ep, 0, sizeof(ep));
+  memcpy(ep, "_SM3_", 5);
+  ep[6] = sizeof(ep);
+  ep[7] = 3;                                      // SMBIOS 3.2.0
+  ep[8] = 2;
+  ep[10] = 1;
+  ep[12] = table.length() & 0xff;
+  ep[13] = (table.length() >> 8) & 0xff;
+  ep[14] = (table.length() >> 16) & 0xff;
+  ep[15] = (table.length() >> 24) & 0xff;
+  for (unsigned int i = 0; i < sizeof(ep); i++)
+    sum += ep[i];
+  ep[5] = -sum;
+
+  return string((const char *)ep, sizeof(ep));
+}
+
+static void usage(const char *progname)
+{
+  fprintf(stderr, "usage: %s [options]\n", progname);
+  fprintf(stderr, "\t-pciids FILE    pci.ids to parse (default: pci.ids)\n");
+  fprintf(stderr, "\t-usbids FILE    usb.ids to parse (default: usb.ids)\n");
+  fprintf(stderr, "\t-cpuinfo FILE   recorded /proc/cpuinfo (default: generated)\n");
+  fprintf(stderr, "\t-cpus N         processors in the generated cpuinfo (default: 1024)\n");
+  fprintf(stderr, "\t-dmi FILE       recorded SMBIOS table, e.g. /sys/firmware/dmi/tables/DMI (default: generated)\n");
+  fprintf(stderr, "\t-dimms N        memory devices in the generated table (default: 512)\n");
+  fprintf(stderr, "\t-repeat N       runs of each benchmark, the fastest is reported (default: 5)\n");
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  string pciids = "pci.ids", usbids = "usb.ids", cpuinfofile = "", dmifile = "";
+  unsigned int cpus = 1024, dimms = 512, repeat = 5;
+  char tmpl[] = "/tmp/parser-bench-XXXXXX";
+  char label[32];
+  string contents = "";
+  vector < benchmark > benchmarks;
+
+  for (int i = 1; i < argc; i++)
+  {
+    string option = argv[i];
+
+    if (i + 1 >= argc)
+      usage(argv[0]);
+    if (option == "-pciids")
+      pciids = argv[++i];
+    else if (option == "-usbids")
+      usbids = argv[++i];
+    else if (option == "-cpuinfo")
+      cpuinfofile = argv[++i];
+    else if (option == "-cpus")
+      cpus = atoi(argv[++i]);
+    else if (option == "-dmi")
+      dmifile = argv[++i];
+    else if (option == "-dimms")
+      dimms = atoi(argv[++i]);
+    else if (option == "-repeat")
+      repeat = atoi(argv[++i]);
+    else
+      usage(argv[0]);
+  }
+  if (repeat == 0)
+    usage(argv[0]);
+
+  if (!mkdtemp(tmpl))
+  {
+    perror(tmpl);
+    exit(1);
+  }
+  tmpdir = tmpl;
+  mkdir((tmpdir + "/proc").c_str(), 0755);
+  mkdir((tmpdir + "/sys").c_str(), 0755);
+  mkdir((tmpdir + "/sys/firmware").c_str(), 0755);
+  mkdir((tmpdir + "/sys/firmware/dmi").c_str(), 0755);
+  mkdir((tmpdir + "/sys/firmware/dmi/tables").c_str(), 0755);
+
+  if (readfile(pciids, contents))
+    benchmarks.push_back((benchmark){ "pci.ids", pciids, "line", countlines(contents), run_pciids });
+  else
+    perror(pciids.c_str());
+  if (readfile(usbids, contents))
+    benchmarks.push_back((benchmark){ "usb.ids", usbids, "line", countlines(contents), run_usbids });
+  else
+    perror(usbids.c_str());
+
+  if (cpuinfofile == "")
+  {
+    snprintf(label, sizeof(label), "%u CPUs", cpus);
+    cpuinfofile = label;
+    contents = cpuinfo(cpus);
+  }
+  else if (!readfile(cpuinfofile, contents))
+  {
+    perror(cpuinfofile.c_str());
+    exit(1);
+  }
+  writefile(tmpdir + "/proc/cpuinfo", contents);
+  benchmarks.push_back((benchmark){ "cpuinfo", cpuinfofile, "line", countlines(contents), run_cpuinfo });
+
+  unsigned long structures = 0;
+  if (dmifile == "")
+  {
+    contents = smbios(dimms, structures);
+    snprintf(label, sizeof(label), "%u DIMMs", dimms);
+    dmifile = label;
+  }
+  else if (!readfile(dmifile, contents))
+  {
+    perror(dmifile.c_str());
+    exit(1);
+  }
+  else
+    structures = countstructures(contents);
+  writefile(tmpdir + "/sys/firmware/dmi/tables/DMI", contents);
+  writefile(tmpdir + "/sys/firmware/dmi/tables/smbios_entry_point", entrypoint(contents));
+  benchmarks.push_back((benchmark){ "SMBIOS", dmifile, "structure", structures, run_dmi });
+
+  printf("%-8s %-20s %8s %-10s %10s %12s %11s %10s\n", "parser", "input", "items", "", "ns/item", "allocs/item", "bytes/item", "total(ms)");
+  for (unsigned int i = 0; i < benchmarks.size(); i++)
+  {
+    const benchmark & b = benchmarks[i];
+    sample best;
+    bool ok = false;
+
+    for (unsigned int r = 0; r < repeat; r++)
+    {
+      sample s;
+
+      if (!measure(b, s))
+        continue;
+      if (!ok || (s.ns < best.ns))
+        best = s;
+      ok = true;
+    }
+
+    if (!ok || (b.items == 0))
+    {
+      printf("%-8s %-20s failed\n", b.parser.c_str(), b.input.c_str());
+      continue;
+    }
+    printf("%-8s %-20s %8lu %-10s %10.1f %12.2f %11.1f %10.2f\n", b.parser.c_str(), b.input.c_str(),
+      b.items, (b.unit + "s").c_str(), best.ns / b.items, (double)best.allocations / b.items,
+      (double)best.bytes / b.items, best.ns / 1e6);
+  }
+
+  unlink((tmpdir + "/proc/cpuinfo").c_str());
+  unlink((tmpdir + "/sys/firmware/dmi/tables/DMI").c_str());
+  unlink((tmpdir + "/sys/firmware/dmi/tables/smbios_entry_point").c_str());
+  rmdir((tmpdir + "/sys/firmware/dmi/tables").c_str());
+  rmdir((tmpdir + "/sys/firmware/dmi").c_str());
+  rmdir((tmpdir + "/sys/firmware").c_str());
+  rmdir((tmpdir + "/sys").c_str());
+  rmdir((tmpdir + "/proc").c_str());
+  rmdir(tmpdir.c_str());
+
+  return 0;
+}
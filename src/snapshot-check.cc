@@ -0,0 +1,128 @@
+/*
+ * snapshot-check.cc
+ *
+ * reads back a snapshot written by lshw -snapshot and checks that every
+ * node can be found again by hardware path and by bus information; with
+ * -sanitized, also checks that the serial numbers of a sanitized snapshot are
+ * removed, and only where the original snapshot has one
+ *
+ */
+
+#include "version.h"
+#include "snapshot.h"
+#include "options.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+__ID("@(#) $Id$");
+
+using namespace std;
+
+void status(const char *)
+{
+}
+
+
+int main(int argc,
+char **argv)
+{
+  hwSnapshot snapshot, original;
+  bool sanitized = false;
+  unsigned int errors = 0;
+  unsigned int paths = 0, businfos = 0;
+
+  if ((argc == 4) && (strcmp(argv[1], "-sanitized") == 0))
+    sanitized = true;
+  else if (argc != 2)
+  {
+    fprintf(stderr, "usage: %s snapshot\n", argv[0]);
+    fprintf(stderr, "       %s -sanitized original sanitized\n", argv[0]);
+    exit(1);
+  }
+
+  if (!snapshot.open(argv[argc - 1]))
+  {
+    fprintf(stderr, "%s: can't open snapshot\n", argv[argc - 1]);
+    exit(1);
+  }
+  if (sanitized && !original.open(argv[2]))
+  {
+    fprintf(stderr, "%s: can't open snapshot\n", argv[2]);
+    exit(1);
+  }
+
+  if ((snapshot.countNodes() == 0) || (snapshot.findByPath("/") != 0) ||
+    (snapshot.getParent(0) != -1))
+  {
+    fprintf(stderr, "root node not found at /\n");
+    errors++;
+  }
+
+  for (unsigned int i = 0; i < snapshot.countNodes(); i++)
+  {
+    const char *path = snapshot.get(i, "path");
+    const char *businfo = snapshot.get(i, "businfo");
+    const char *serial = snapshot.get(i, "serial");
+
+    for (unsigned int j = 0; j < snapshot.countChildren(i); j++)
+      if (snapshot.getParent(snapshot.getChild(i, j)) != (long)i)
+      {
+        fprintf(stderr, "node %u: child %u doesn't point back to it\n", i, j);
+        errors++;
+      }
+
+    if (path && *path)
+    {
+      paths++;
+      if (snapshot.findByPath(path) != (long)i)
+      {
+        fprintf(stderr, "node %u: not found by path %s\n", i, path);
+        errors++;
+      }
+    }
+
+    if (businfo && *businfo)
+    {
+      long found = snapshot.findByBusInfo(businfo);
+      const char *other = (found >= 0) ? snapshot.get(found, "businfo") : NULL;
+
+      businfos++;
+      if (!other || (strcmp(other, businfo) != 0))      // may be shared by several nodes
+      {
+        fprintf(stderr, "node %u: not found by bus info %s\n", i, businfo);
+        errors++;
+      }
+    }
+
+    if (sanitized && path)
+    {
+      long o = original.findByPath(path);
+      const char *before = (o >= 0) ? original.get(o, "serial") : NULL;
+      bool had = before && *before;
+      bool has = serial && *serial;
+
+      if (has && (strcmp(serial, REMOVED) != 0))
+      {
+        fprintf(stderr, "node %u: serial number not removed\n", i);
+        errors++;
+      }
+      if ((o >= 0) && has && !had)
+      {
+        fprintf(stderr, "node %u: serial number on a node that has none\n", i);
+        errors++;
+      }
+      if ((o >= 0) && had && !has)
+      {
+        fprintf(stderr, "node %u: serial number lost\n", i);
+        errors++;
+      }
+    }
+  }
+
+  printf("%s: %u nodes, %u paths, %u bus infos, %u errors\n", argv[argc - 1],
+    snapshot.countNodes(), paths, businfos, errors);
+
+  return errors ? 1 : 0;
+}